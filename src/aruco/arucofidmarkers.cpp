@@ -532,80 +532,158 @@ int FiducidalMarkers::analyzeMarkerImage(Mat &grey,int &nRotations)
     //Markers  are divided in 7x7 regions, of which the inner 5x5 belongs to marker info
     //the external border shoould be entirely black
 
-    int swidth=grey.rows/7;
+    //The non zero pixels of each region are counted with an integral image, so each region costs
+    //four lookups. The integral image is built one row of regions at a time, so that a white border
+    //region rejects the candidate before the rest of the image is read.
+    const int swidth=grey.rows/7;
+    const int size=7*swidth;
+    const int step=size+1;
+    int sumStack[MaxIntegralStep*MaxIntegralStep];
+    vector<int> sumHeap;
+    int *sum=sumStack;
+    if (step>MaxIntegralStep) {
+        sumHeap.resize(step*step);
+        sum=&sumHeap[0];
+    }
+    for (int c=0;c<step;c++) sum[c]=0;
+    const int halfArea=(swidth*swidth) /2;
+
+    //5x5 bits of the inner regions, bit y*5+x is region (y+1,x+1)
+    unsigned int code=0;
+    //get information(for each inner square, determine if it is  black or white)
+
     for (int y=0;y<7;y++)
     {
-        int inc=6;
-        if (y==0 || y==6) inc=1;//for first and last row, check the whole border
-        for (int x=0;x<7;x+=inc)
+        //extend the integral image to the bottom of this row of regions
+        for (int r=y*swidth+1;r<=(y+1)*swidth;r++)
+        {
+            const uchar *pGrey=grey.ptr<uchar>(r-1);
+            const int *pSumUp=sum+(r-1)*step;
+            int *pSum=sum+r*step;
+            int rowSum=0;
+            pSum[0]=0;
+            for (int c=1;c<=size;c++)
+            {
+                rowSum+= pGrey[c-1]!=0;
+                pSum[c]=pSumUp[c]+rowSum;
+            }
+        }
+
+        const int *pSumTop=sum+y*swidth*step;
+        const int *pSumBottom=sum+(y+1)*swidth*step;
+        for (int x=0;x<7;x++)
         {
-            int Xstart=(x)*(swidth);
-            int Ystart=(y)*(swidth);
-            Mat square=grey(Rect(Xstart,Ystart,swidth,swidth));
-            int nZ=countNonZero(square);
-            if (nZ> (swidth*swidth) /2) {
+            int x0=x*swidth,x1=(x+1)*swidth;
+            int nZ=pSumBottom[x1]-pSumBottom[x0]-pSumTop[x1]+pSumTop[x0];
+            if (y==0 || y==6 || x==0 || x==6) {
+                if (nZ> halfArea) {
 // 		cout<<"neb"<<endl;
-                return -1;//can not be a marker because the border element is not black!
+                    return -1;//can not be a marker because the border element is not black!
+                }
             }
+            else if (nZ> halfArea) code|=1u<<((y-1)*5+x-1);
         }
     }
 
-    //now,
-    vector<int> markerInfo(5);
-    Mat _bits=Mat::zeros(5,5,CV_8UC1);
-    //get information(for each inner square, determine if it is  black or white)
+    return decodePackedRotations(code,nRotations);
+}
 
-    for (int y=0;y<5;y++)
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+int FiducidalMarkers::decodePackedRotations(unsigned int code,int &nRotations)
+{
+    //check all possible rotations, the first one giving a valid code is taken
+    for (int i=0;i<4;i++)
     {
-
-        for (int x=0;x<5;x++)
-        {
-            int Xstart=(x+1)*(swidth);
-            int Ystart=(y+1)*(swidth);
-            Mat square=grey(Rect(Xstart,Ystart,swidth,swidth));
-            int nZ=countNonZero(square);
-            if (nZ> (swidth*swidth) /2)  _bits.at<uchar>( y,x)=1;
+        int id=decodePackedMarker(code);
+        if (id!=-1) {
+            nRotations=i;
+            return id;
         }
+        code=rotatePackedMarker(code);
     }
-// 		printMat<uchar>( _bits,"or mat");
-
-    //checkl all possible rotations
-    Mat _bitsFlip;
-    Mat Rotations[4];
-    Rotations[0]=_bits;
-    int dists[4];
-    dists[0]=hammDistMarker( Rotations[0]) ;
-    pair<int,int> minDist( dists[0],0);
-    for (int i=1;i<4;i++)
+    nRotations=0;
+    return -1;
+}
+
+/************************************
+ *
+ * Lookup tables for codes packed in 25 bits, bit y*5+x being the bit at row y and column x
+ *
+ ************************************/
+namespace {
+struct PackedMarkerTables
+{
+    //value (0..3) of each valid 5 bits row, -1 if it is not a valid row
+    int rowValue[32];
+    //rotated code of each row value, for each row
+    unsigned int rowRotation[5][32];
+
+    PackedMarkerTables()
     {
-        //rotate
-        Rotations[i]=rotate(Rotations[i-1]);
-        //get the hamming distance to the nearest possible word
-        dists[i]=hammDistMarker( Rotations[i]) ;
-        if (dists[i]<minDist.first)
+        //the possible words of a row, see hammDistMarker. The value of a row is given by its bits 1 and 3
+        const int words[4][5]={{1,0,0,0,0},{1,0,1,1,1},{0,1,0,0,1},{0,1,1,1,0}};
+        for (int v=0;v<32;v++) rowValue[v]=-1;
+        for (int p=0;p<4;p++)
         {
-            minDist.first=  dists[i];
-            minDist.second=i;
+            int v=0;
+            for (int x=0;x<5;x++) v|=words[p][x]<<x;
+            rowValue[v]=p;
         }
+        //rotate maps (i,j) to (4-j,i) as FiducidalMarkers::rotate, so row r becomes column 4-r
+        for (int r=0;r<5;r++)
+            for (int v=0;v<32;v++)
+            {
+                rowRotation[r][v]=0;
+                for (int i=0;i<5;i++)
+                    if (v&(1<<i)) rowRotation[r][v]|=1u<<(i*5+4-r);
+            }
     }
-// 		        printMat<uchar>( Rotations [ minDist.second]);
-// 		 	cout<<"MinDist="<<minDist.first<<" "<<minDist.second<<endl;
-
-    nRotations=minDist.second;
-    if (minDist.first!=0)	 //FUTURE WORK: correct if any error
-        return -1;
-    else {//Get id of the marker
-        int MatID=0;
-        cv::Mat bits=Rotations [ minDist.second];
-        for (int y=0;y<5;y++)
-        {
-            MatID<<=1;
-            if ( bits.at<uchar>(y,1)) MatID|=1;
-            MatID<<=1;
-            if ( bits.at<uchar>(y,3)) MatID|=1;
-        }
-        return MatID;
+};
+
+const PackedMarkerTables &getPackedMarkerTables()
+{
+    static const PackedMarkerTables tables;
+    return tables;
+}
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+int FiducidalMarkers::decodePackedMarker(unsigned int code)
+{
+    const PackedMarkerTables &tables=getPackedMarkerTables();
+    int id=0;
+    for (int y=0;y<5;y++)
+    {
+        int p=tables.rowValue[(code>>(y*5))&31];
+        if (p==-1) return -1;
+        id=(id<<2)|p;
     }
+    return id;
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+unsigned int FiducidalMarkers::rotatePackedMarker(unsigned int code)
+{
+    const PackedMarkerTables &tables=getPackedMarkerTables();
+    unsigned int out=0;
+    for (int r=0;r<5;r++)
+        out|=tables.rowRotation[r][(code>>(r*5))&31];
+    return out;
 }
 
 
@@ -657,6 +735,88 @@ bool FiducidalMarkers::correctHammMarker(Mat &bits)
     return true;
 }
 
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+int FiducidalMarkers::detect(const Mat &grey,const Mat &H,int &nRotations,int samplesPerCell)
+{
+    assert(grey.type()==CV_8UC1);
+    int k=samplesPerCell;
+    if (k>MaxSamplesPerCell) k=MaxSamplesPerCell;
+    if (k<1) k=1;
+    const int nSamples=k*k;
+    //grey level of the samples, cell by cell
+    uchar samples[49*MaxSamplesPerCell*MaxSamplesPerCell];
+    int hist[256];
+    for (int i=0;i<256;i++) hist[i]=0;
+
+    Mat_<double> h;
+    H.convertTo(h,CV_64F);
+    const double *m=h[0];
+    const int maxX=grey.cols-1,maxY=grey.rows-1;
+    uchar *s=samples;
+    for (int y=0;y<7;y++)
+        for (int x=0;x<7;x++)
+            for (int sy=0;sy<k;sy++)
+                for (int sx=0;sx<k;sx++)
+                {
+                    //k x k points spread over the central 70% of the cell
+                    double cx=x+0.5+ ( (sx+0.5) /k-0.5 ) *0.7;
+                    double cy=y+0.5+ ( (sy+0.5) /k-0.5 ) *0.7;
+                    double w=m[6]*cx+m[7]*cy+m[8];
+                    float px=float ( (m[0]*cx+m[1]*cy+m[2]) /w );
+                    float py=float ( (m[3]*cx+m[4]*cy+m[5]) /w );
+                    //bilinear interpolation, clamped to the image
+                    px=std::min(std::max(px,0.f),float(maxX));
+                    py=std::min(std::max(py,0.f),float(maxY));
+                    int ix=int(px),iy=int(py);
+                    float fx=px-ix,fy=py-iy;
+                    const uchar *r0=grey.ptr<uchar>(iy),*r1=grey.ptr<uchar>(std::min(iy+1,maxY));
+                    int ix1=std::min(ix+1,maxX);
+                    float v= (1-fy) * ( (1-fx) *r0[ix]+fx*r0[ix1] ) +fy* ( (1-fx) *r1[ix]+fx*r1[ix1] );
+                    *s=uchar ( v+0.5f );
+                    hist[*s]++;
+                    s++;
+                }
+
+    //Otsu threshold of the samples, as threshold(...,THRESH_OTSU) on the canonical image
+    const int total=49*nSamples;
+    double sumAll=0;
+    for (int i=0;i<256;i++) sumAll+=i*hist[i];
+    double sumBack=0,maxVar=0;
+    int nBack=0,thres=0;
+    for (int i=0;i<256;i++)
+    {
+        nBack+=hist[i];
+        if (nBack==0) continue;
+        int nFore=total-nBack;
+        if (nFore==0) break;
+        sumBack+=i*hist[i];
+        double mBack=sumBack/nBack,mFore= (sumAll-sumBack) /nFore;
+        double var=double ( nBack ) *nFore* ( mBack-mFore ) * ( mBack-mFore );
+        if (var>maxVar) { maxVar=var; thres=i; }
+    }
+
+    //a cell is white when most of its samples are above the threshold, the border must be black
+    unsigned int code=0;
+    s=samples;
+    for (int y=0;y<7;y++)
+        for (int x=0;x<7;x++)
+        {
+            int nZ=0;
+            for (int i=0;i<nSamples;i++,s++) nZ+= *s>thres;
+            bool white=nZ> nSamples/2;
+            if (y==0 || y==6 || x==0 || x==6) {
+                if (white) return -1;//can not be a marker because the border element is not black!
+            }
+            else if (white) code|=1u<< ( (y-1) *5+x-1 );
+        }
+    return decodePackedRotations(code,nRotations);
+}
+
 /************************************
  *
  *
@@ -71,6 +71,18 @@ public:
      */
     static int detect(const cv::Mat &in,int &nRotations);
 
+    /** Detection of fiducidal aruco markers (10 bits) directly in the image, without warping a canonical image.
+     * The interior of each of the 7x7 cells is sampled at samplesPerCell x samplesPerCell points through the homography,
+     * the samples are thresholded with Otsu and each cell takes the value of most of its samples.
+     * @param grey 8UC1 image with the possible marker
+     * @param H 3x3 homography from the canonical marker, with the cells in [0,7]x[0,7], to the image
+     * @param nRotations number of 90deg rotations in clockwise direction needed to set the marker in correct position
+     * @param samplesPerCell samples along each side of a cell, at most MaxSamplesPerCell
+     * @return -1 if the image passed is a not a valid marker, and its id in case it really is a marker
+     */
+    static int detect(const cv::Mat &grey,const cv::Mat &H,int &nRotations,int samplesPerCell=3);
+    static const int MaxSamplesPerCell=4;
+
     /**Similar to createMarkerImage. Instead of returning a visible image, returns a 8UC1 matrix of 0s and 1s with the marker info
      */
     static cv::Mat getMarkerMat(int id) throw (cv::Exception);
@@ -117,10 +129,18 @@ public:
 
 private:
   
+    //integral images up to this step are kept on the stack in analyzeMarkerImage
+    static const int MaxIntegralStep=64;
     static vector<int> getListOfValidMarkersIds_random(int nMarkers,vector<int> *excluded) throw (cv::Exception);
     static  cv::Mat rotate(const cv::Mat & in);
     static  int hammDistMarker(cv::Mat  bits);
     static  int analyzeMarkerImage(cv::Mat &grey,int &nRotations);
+    //id of a 5x5 code packed in 25 bits (bit y*5+x), -1 if not valid
+    static  int decodePackedMarker(unsigned int code);
+    //packed version of rotate
+    static  unsigned int rotatePackedMarker(unsigned int code);
+    //id of the first rotation of code that is valid, -1 if none
+    static  int decodePackedRotations(unsigned int code,int &nRotations);
     static  bool correctHammMarker(cv::Mat &bits);
 };
 
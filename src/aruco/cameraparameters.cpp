@@ -27,6 +27,7 @@ or implied, of Rafael Muñoz Salinas.
 ********************************/
 #include "stdafx.h"
 #include "cameraparameters.h"
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <opencv/cv.h>
@@ -39,6 +40,7 @@ CameraParameters::CameraParameters() {
     CameraMatrix=cv::Mat();
     Distorsion=cv::Mat();
     CamSize=cv::Size(-1,-1);
+    UndistortTileSize=0;
 }
 /**Creates the object from the info passed
  * @param cameraMatrix 3x3 matrix (fx 0 cx, 0 fy cy, 0 0 1)
@@ -54,6 +56,9 @@ CameraParameters::CameraParameters(const CameraParameters &CI) {
     CI.CameraMatrix.copyTo(CameraMatrix);
     CI.Distorsion.copyTo(Distorsion);
     CamSize=CI.CamSize;
+    //the table is never modified once built, so it is shared
+    UndistortTable=CI.UndistortTable;
+    UndistortTileSize=CI.UndistortTileSize;
 }
 
 /**
@@ -62,6 +67,8 @@ CameraParameters & CameraParameters::operator=(const CameraParameters &CI) {
     CI.CameraMatrix.copyTo(CameraMatrix);
     CI.Distorsion.copyTo(Distorsion);
     CamSize=CI.CamSize;
+    UndistortTable=CI.UndistortTable;
+    UndistortTileSize=CI.UndistortTileSize;
     return *this;
 }
 /**
@@ -82,7 +89,8 @@ void CameraParameters::setParams(cv::Mat cameraMatrix,cv::Mat distorsionCoeff,cv
 //         Distorsion.ptr<float>(0)[i]=auxD.ptr<float>(0)[i];
 
     CamSize=size;
-
+    if (isValid()) buildUndistortionTable();
+    else UndistortTable.release();
 }
 
 /**
@@ -135,6 +143,8 @@ void CameraParameters::readFromFile(string path)throw(cv::Exception)
             else if (scmd=="height") CamSize.height=fval;
         }
     }
+    if (isValid()) buildUndistortionTable();
+    else UndistortTable.release();
 }
 /**Saves this to a file
   */
@@ -179,6 +189,63 @@ void CameraParameters::resize(cv::Size size)throw(cv::Exception)
     CameraMatrix.at<float>(0,2)*=AxFactor;
     CameraMatrix.at<float>(1,1)*=AyFactor;
     CameraMatrix.at<float>(1,2)*=AyFactor;
+    //the parameters now correspond to size, so that calling it again with the same size does not scale them again
+    CamSize=size;
+    buildUndistortionTable(UndistortTileSize>0?UndistortTileSize:8);
+}
+
+/**
+ */
+void CameraParameters::buildUndistortionTable(int tileSize)throw(cv::Exception)
+{
+    if (!isValid())  throw cv::Exception(9007,"invalid object","CameraParameters::buildUndistortionTable",__FILE__,__LINE__);
+    if (tileSize<=0) throw cv::Exception(9007,"invalid tileSize","CameraParameters::buildUndistortionTable",__FILE__,__LINE__);
+    //nodes up to the last pixel of the image, at least two in each direction
+    int nx=std::max(2,(CamSize.width-1+tileSize-1)/tileSize+1);
+    int ny=std::max(2,(CamSize.height-1+tileSize-1)/tileSize+1);
+    vector<cv::Point2f> nodes,normalized;
+    nodes.reserve(nx*ny);
+    for (int y=0;y<ny;y++)
+        for (int x=0;x<nx;x++)
+            nodes.push_back(cv::Point2f(float(x*tileSize),float(y*tileSize)));
+    cv::undistortPoints(nodes,normalized,CameraMatrix,Distorsion);
+    //new data, copies of this object can share the old table
+    UndistortTable=cv::Mat(normalized).reshape(2,ny).clone();
+    UndistortTileSize=tileSize;
+}
+
+/**
+ */
+void CameraParameters::undistortPoints(const vector<cv::Point2f> &points,vector<cv::Point2f> &normalized)const throw(cv::Exception)
+{
+    if (UndistortTable.empty()) {
+        cv::undistortPoints(points,normalized,CameraMatrix,Distorsion);
+        return;
+    }
+    normalized.resize(points.size());
+    //points out of the table are undistorted all together at the end
+    vector<cv::Point2f> outPoints,outNormalized;
+    vector<size_t> outIdx;
+    float invTile=1.f/float(UndistortTileSize);
+    int maxX=UndistortTable.cols-2,maxY=UndistortTable.rows-2;
+    for (size_t i=0;i<points.size();i++) {
+        float fx=points[i].x*invTile,fy=points[i].y*invTile;
+        if (!(fx>=0 && fy>=0 && fx<=float(maxX+1) && fy<=float(maxY+1))) {
+            outPoints.push_back(points[i]);
+            outIdx.push_back(i);
+            continue;
+        }
+        int ix=std::min(int(fx),maxX),iy=std::min(int(fy),maxY);
+        float wx=fx-float(ix),wy=fy-float(iy);
+        const cv::Vec2f *t0=UndistortTable.ptr<cv::Vec2f>(iy)+ix;
+        const cv::Vec2f *t1=UndistortTable.ptr<cv::Vec2f>(iy+1)+ix;
+        float x0=t0[0][0]+(t0[1][0]-t0[0][0])*wx,x1=t1[0][0]+(t1[1][0]-t1[0][0])*wx;
+        float y0=t0[0][1]+(t0[1][1]-t0[0][1])*wx,y1=t1[0][1]+(t1[1][1]-t1[0][1])*wx;
+        normalized[i]=cv::Point2f(x0+(x1-x0)*wy,y0+(y1-y0)*wy);
+    }
+    if (outPoints.empty()) return;
+    cv::undistortPoints(outPoints,outNormalized,CameraMatrix,Distorsion);
+    for (size_t i=0;i<outIdx.size();i++) normalized[outIdx[i]]=outNormalized[i];
 }
 
 /****
@@ -217,6 +284,8 @@ void CameraParameters::readFromXMLFile(string filePath)throw(cv::Exception)
 
     CamSize.width=w;
     CamSize.height=h;
+    if (isValid()) buildUndistortionTable();
+    else UndistortTable.release();
 }
 /****
  *
@@ -85,10 +85,23 @@ public:
      */
     void readFromXMLFile(string filePath)throw(cv::Exception);
 
-    /**Adjust the parameters to the size of the image indicated
+    /**Adjust the parameters to the size of the image indicated. CamSize is set to size, and the undistortion table rebuilt
      */
     void resize(cv::Size size)throw(cv::Exception);
 
+    /**Builds the table employed by undistortPoints, with the normalized coordinates of a grid of nodes separated
+     * tileSize pixels that covers the image. setParams, readFromFile, readFromXMLFile and resize call it. The table is not
+     * checked against the parameters when used, so call it again if CameraMatrix, Distorsion or CamSize are changed directly.
+     * With tileSize=8 the error of the interpolation is a few hundredths of pixel even for strong distortions
+     */
+    void buildUndistortionTable(int tileSize=8)throw(cv::Exception);
+
+    /**Same as cv::undistortPoints(points,normalized,CameraMatrix,Distorsion), i.e., returns the normalized image coordinates
+     * of the points. The points inside the image are bilinearly interpolated in the table built by buildUndistortionTable,
+     * the rest of points (or all of them if there is no table) are undistorted with cv::undistortPoints
+     */
+    void undistortPoints(const vector<cv::Point2f> &points,vector<cv::Point2f> &normalized)const throw(cv::Exception);
+
     /**Returns the location of the camera in the reference system given by the rotation and translation vectors passed
      * NOT TESTED
     */
@@ -120,6 +133,10 @@ public:
     
 
 private:
+    //normalized coordinates (CV_32FC2) of the nodes (x,y)*UndistortTileSize, see buildUndistortionTable
+    cv::Mat UndistortTable;
+    int UndistortTileSize;
+
     //GL routines
 
     static void argConvGLcpara2( double cparam[3][4], int width, int height, double gnear, double gfar, double m[16], bool invert )throw(cv::Exception);
@@ -0,0 +1,129 @@
+#include "contourscanner.h"
+#include <algorithm>
+#include <cstring>
+
+namespace aruco
+{
+
+namespace
+{
+//neighbours in the order of the chain codes of OpenCV, counterclockwise from the right one
+const cv::Point CodeDeltas[8]={cv::Point(1,0),cv::Point(1,-1),cv::Point(0,-1),cv::Point(-1,-1),
+                               cv::Point(-1,0),cv::Point(-1,1),cv::Point(0,1),cv::Point(1,1)};
+//marks of the traced border pixels, as cv::findContours in list mode
+const signed char MarkBorder=2;
+const signed char MarkRightBorder=(signed char)(MarkBorder|-128);
+}
+
+/**
+ */
+void ContourScanner::start(unsigned char *img,size_t step,int width,int height,cv::Point offset)
+{
+    _img=(signed char *)img;
+    _step=step;
+    _width=width;
+    _height=height;
+    _offset=offset;
+    _x=1;
+    _y=1;
+    _prev=0;
+    for (int y=0;y<height;y++)
+    {
+        unsigned char *row=img+y*step;
+        if (y==0 || y==height-1)
+        {
+            memset(row,0,width);
+            continue;
+        }
+        row[0]=row[width-1]=0;
+        for (int x=1;x<width-1;x++)
+            row[x]=row[x]!=0;
+    }
+}
+
+/**
+ */
+int ContourScanner::next(std::vector<cv::Point> &contour,int minSize,int maxSize)
+{
+    for (;_y<_height-1;_y++)
+    {
+        signed char *row=_img+_y*_step;
+        for (;_x<_width-1;_x++)
+        {
+            int p=row[_x];
+            if (p==_prev) continue;
+            //an outer border starts at 0->1, a hole border at the pixel before 1->0 (or 2->0 if traced as outer)
+            bool outer=_prev==0 && p==1;
+            bool hole=p==0 && _prev>=1;
+            _prev=p;
+            if (!outer && !hole) continue;
+            int x0=hole?_x-1:_x;
+            int length=trace(row+x0,cv::Point(x0+_offset.x,_y+_offset.y),hole,contour,maxSize);
+            if (length<=minSize || length>=maxSize) contour.clear();
+            //the scan goes on after this pixel, that the trace may have marked
+            _x++;
+            _prev=row[_x-1];
+            return length;
+        }
+        _x=1;
+        _prev=0;
+    }
+    contour.clear();
+    return 0;
+}
+
+/**
+ */
+int ContourScanner::trace(signed char *ptr,cv::Point pt,bool hole,std::vector<cv::Point> &contour,int maxSize)
+{
+    int deltas[16];
+    int step=int(_step);
+    for (int k=0;k<16;k++) deltas[k]=CodeDeltas[k&7].x+CodeDeltas[k&7].y*step;
+
+    contour.clear();
+    signed char *i0=ptr,*i1,*i3,*i4=0;
+    int s,sEnd;
+    //first neighbour of the border, clockwise from the background pixel
+    sEnd=s=hole?0:4;
+    do
+    {
+        s=(s-1)&7;
+        i1=i0+deltas[s];
+    }
+    while (*i1==0 && s!=sEnd);
+
+    //single pixel
+    if (s==sEnd)
+    {
+        *i0=MarkRightBorder;
+        if (maxSize>0) contour.push_back(pt);
+        return 1;
+    }
+
+    int length=0;
+    i3=i0;
+    for (;;)
+    {
+        //next border pixel, counterclockwise from the previous one
+        sEnd=s;
+        s=std::min(s,15);
+        while (s<15)
+        {
+            i4=i3+deltas[++s];
+            if (*i4!=0) break;
+        }
+        s&=7;
+        if ((unsigned)(s-1)<(unsigned)sEnd) *i3=MarkRightBorder;
+        else if (*i3==1) *i3=MarkBorder;
+        //once the contour is too long its points are not stored, but it is followed to the end to mark it
+        if (length<maxSize) contour.push_back(pt);
+        length++;
+        pt+=CodeDeltas[s];
+        if (i4==i0 && i3==i1) break;
+        i3=i4;
+        s=(s+4)&7;
+    }
+    return length;
+}
+
+}
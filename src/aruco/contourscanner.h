@@ -0,0 +1,50 @@
+#ifndef _ARUCO_ContourScanner_H
+#define _ARUCO_ContourScanner_H
+#include <cstddef>
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "exports.h"
+
+namespace aruco
+{
+
+/**\brief Contour extraction of the candidates of detectRectangles, one contour at a time
+ *
+ * The contours are the same as the ones of cv::findContours(img,contours,CV_RETR_LIST,CV_CHAIN_APPROX_NONE) (Suzuki border
+ * following), in reverse order, but without hierarchy and with a size window: the points of a contour are only stored
+ * while its length is below the max size, and contours outside the window are returned empty, so the long contours of
+ * textured areas and the many tiny ones of noise never get to memory. The image is modified during the scan.
+ */
+class ARUCO_EXPORTS ContourScanner
+{
+public:
+    /**Starts the scan of the 8 bit image img, whose non zero pixels are set to 1 and its border pixels to 0. To get the
+     * contours that touch the border, as cv::findContours does since OpenCV 3.2, pad the image with a border of 1 pixel
+     * and pass offset (-1,-1)
+     * @param offset added to the points of the contours
+     */
+    void start(unsigned char *img,size_t step,int width,int height,cv::Point offset=cv::Point(0,0));
+
+    /**Traces the next contour of the image
+     * @param contour output points of the contour if its length is in (minSize,maxSize), empty otherwise. Pass the same
+     * vector on successive calls to avoid reallocations
+     * @param minSize the contours of minSize points or less are left empty
+     * @param maxSize the contours of maxSize points or more are left empty, and at most maxSize points are written
+     * @return length of the contour in points, 0 if there are no more contours
+     */
+    int next(std::vector<cv::Point> &contour,int minSize,int maxSize);
+
+private:
+    //traces the border starting at pixel pt (ptr), outer or hole border, as icvFetchContour of OpenCV
+    int trace(signed char *ptr,cv::Point pt,bool hole,std::vector<cv::Point> &contour,int maxSize);
+
+    signed char *_img;
+    size_t _step;
+    int _width,_height;
+    cv::Point _offset;
+    //scan position and value of the pixel before it
+    int _x,_y,_prev;
+};
+
+}
+#endif
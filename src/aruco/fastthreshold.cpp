@@ -0,0 +1,332 @@
+#include "fastthreshold.h"
+#include <cmath>
+#include <algorithm>
+#include <opencv2/core/version.hpp>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+//x86 kernels are compiled with target attributes and selected at run time, so they do not
+//depend on the compiler flags of the project
+#define ARUCO_FASTTHRESHOLD_X86
+#include <immintrin.h>
+#endif
+
+namespace aruco
+{
+
+namespace
+{
+//fixed point coefficients of cv::cvtColor for BGR2GRAY, OpenCV 4 moved to 15 bits
+#if CV_VERSION_MAJOR>=4
+const int GreyShift=15;
+const int GreyB=3735,GreyG=19235,GreyR=9798;
+#else
+const int GreyShift=14;
+const int GreyB=1868,GreyG=9617,GreyR=4899;
+#endif
+
+//index of p in [0,len) with BORDER_REFLECT_101, as cv::borderInterpolate
+inline int reflect101(int p,int len)
+{
+    if (len==1) return 0;
+    while (p<0 || p>=len)
+    {
+        if (p<0) p=-p;
+        else p=2*len-2-p;
+    }
+    return p;
+}
+
+//Row kernels. Each SIMD version handles a multiple of its vector width and returns the
+//number of pixels done, the scalar loops finish the row.
+
+//d[x]=grey(s[3x],s[3x+1],s[3x+2])
+void greyRow(const unsigned char *s,unsigned char *d,int x,int width)
+{
+    for (;x<width;x++)
+        d[x]=(unsigned char)((s[3*x]*GreyB+s[3*x+1]*GreyG+s[3*x+2]*GreyR+(1<<(GreyShift-1)))>>GreyShift);
+}
+
+//col[x]+=add[x]-sub[x]
+void updateColumnSums(int *col,const unsigned char *add,const unsigned char *sub,int x,int width)
+{
+    for (;x<width;x++)
+        col[x]+=add[x]-sub[x];
+}
+
+//dst[x]=255 if 2*box[x]-c>=src[x]*m, 0 otherwise
+void compareBoxSums(const int *box,const unsigned char *src,unsigned char *dst,int x,int width,int m,int c)
+{
+    for (;x<width;x++)
+        dst[x]=(2*box[x]-c>=src[x]*m)?255:0;
+}
+
+#ifdef ARUCO_FASTTHRESHOLD_X86
+//8 pixels (24 bytes) per iteration: b,g and r,1 are gathered as 16 bit pairs and
+//multiplied-added with the coefficients and the rounding term
+__attribute__((target("ssse3")))
+int greyRowSSSE3(const unsigned char *s,unsigned char *d,int width)
+{
+    const __m128i coefBG=_mm_set1_epi32((GreyG<<16)|GreyB);
+    const __m128i coefR1=_mm_set1_epi32(((1<<(GreyShift-1))<<16)|GreyR);
+    const __m128i one=_mm_set1_epi32(1<<16);
+    const __m128i shufBG0=_mm_setr_epi8(0,-1,1,-1,3,-1,4,-1,6,-1,7,-1,9,-1,10,-1);
+    const __m128i shufR0=_mm_setr_epi8(2,-1,-1,-1,5,-1,-1,-1,8,-1,-1,-1,11,-1,-1,-1);
+    const __m128i shufBG1=_mm_setr_epi8(4,-1,5,-1,7,-1,8,-1,10,-1,11,-1,13,-1,14,-1);
+    const __m128i shufR1=_mm_setr_epi8(6,-1,-1,-1,9,-1,-1,-1,12,-1,-1,-1,15,-1,-1,-1);
+    int x=0;
+    for (;x<=width-8;x+=8)
+    {
+        __m128i a=_mm_loadu_si128((const __m128i*)(s+3*x));
+        __m128i b=_mm_loadu_si128((const __m128i*)(s+3*x+8));
+        __m128i g0=_mm_add_epi32(_mm_madd_epi16(_mm_shuffle_epi8(a,shufBG0),coefBG),
+                                 _mm_madd_epi16(_mm_or_si128(_mm_shuffle_epi8(a,shufR0),one),coefR1));
+        __m128i g1=_mm_add_epi32(_mm_madd_epi16(_mm_shuffle_epi8(b,shufBG1),coefBG),
+                                 _mm_madd_epi16(_mm_or_si128(_mm_shuffle_epi8(b,shufR1),one),coefR1));
+        __m128i g=_mm_packs_epi32(_mm_srai_epi32(g0,GreyShift),_mm_srai_epi32(g1,GreyShift));
+        _mm_storel_epi64((__m128i*)(d+x),_mm_packus_epi16(g,g));
+    }
+    return x;
+}
+
+__attribute__((target("sse2")))
+int updateColumnSumsSSE2(int *col,const unsigned char *add,const unsigned char *sub,int width)
+{
+    const __m128i zero=_mm_setzero_si128();
+    int x=0;
+    for (;x<=width-16;x+=16)
+    {
+        __m128i a=_mm_loadu_si128((const __m128i*)(add+x));
+        __m128i s=_mm_loadu_si128((const __m128i*)(sub+x));
+        __m128i dLo=_mm_sub_epi16(_mm_unpacklo_epi8(a,zero),_mm_unpacklo_epi8(s,zero));
+        __m128i dHi=_mm_sub_epi16(_mm_unpackhi_epi8(a,zero),_mm_unpackhi_epi8(s,zero));
+        __m128i d[4]={_mm_srai_epi32(_mm_unpacklo_epi16(dLo,dLo),16),_mm_srai_epi32(_mm_unpackhi_epi16(dLo,dLo),16),
+                      _mm_srai_epi32(_mm_unpacklo_epi16(dHi,dHi),16),_mm_srai_epi32(_mm_unpackhi_epi16(dHi,dHi),16)};
+        for (int i=0;i<4;i++)
+        {
+            __m128i c=_mm_loadu_si128((const __m128i*)(col+x+4*i));
+            _mm_storeu_si128((__m128i*)(col+x+4*i),_mm_add_epi32(c,d[i]));
+        }
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+int updateColumnSumsAVX2(int *col,const unsigned char *add,const unsigned char *sub,int width)
+{
+    int x=0;
+    for (;x<=width-8;x+=8)
+    {
+        __m256i a=_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(add+x)));
+        __m256i s=_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(sub+x)));
+        __m256i c=_mm256_loadu_si256((const __m256i*)(col+x));
+        _mm256_storeu_si256((__m256i*)(col+x),_mm256_add_epi32(c,_mm256_sub_epi32(a,s)));
+    }
+    return x;
+}
+
+//s*m is done with a 16 bit multiply-add, so m must fit in 16 bits (blockSize<=127)
+__attribute__((target("sse2")))
+int compareBoxSumsSSE2(const int *box,const unsigned char *src,unsigned char *dst,int width,int m,int c)
+{
+    if (m>=32768) return 0;
+    const __m128i zero=_mm_setzero_si128();
+    const __m128i mm=_mm_set1_epi32(m),cc=_mm_set1_epi32(c);
+    int x=0;
+    for (;x<=width-16;x+=16)
+    {
+        __m128i s8=_mm_loadu_si128((const __m128i*)(src+x));
+        __m128i s16[2]={_mm_unpacklo_epi8(s8,zero),_mm_unpackhi_epi8(s8,zero)};
+        __m128i less[4];
+        for (int i=0;i<4;i++)
+        {
+            __m128i s=(i%2==0)?_mm_unpacklo_epi16(s16[i/2],zero):_mm_unpackhi_epi16(s16[i/2],zero);
+            __m128i b=_mm_loadu_si128((const __m128i*)(box+x+4*i));
+            __m128i lhs=_mm_sub_epi32(_mm_slli_epi32(b,1),cc);
+            less[i]=_mm_cmpgt_epi32(_mm_madd_epi16(s,mm),lhs);
+        }
+        __m128i r=_mm_packs_epi16(_mm_packs_epi32(less[0],less[1]),_mm_packs_epi32(less[2],less[3]));
+        _mm_storeu_si128((__m128i*)(dst+x),_mm_xor_si128(r,_mm_set1_epi8(-1)));
+    }
+    return x;
+}
+
+__attribute__((target("avx2")))
+int compareBoxSumsAVX2(const int *box,const unsigned char *src,unsigned char *dst,int width,int m,int c)
+{
+    const __m256i mm=_mm256_set1_epi32(m),cc=_mm256_set1_epi32(c);
+    int x=0;
+    for (;x<=width-16;x+=16)
+    {
+        __m256i less[2];
+        for (int i=0;i<2;i++)
+        {
+            __m256i s=_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src+x+8*i)));
+            __m256i b=_mm256_loadu_si256((const __m256i*)(box+x+8*i));
+            __m256i lhs=_mm256_sub_epi32(_mm256_slli_epi32(b,1),cc);
+            less[i]=_mm256_cmpgt_epi32(_mm256_mullo_epi32(s,mm),lhs);
+        }
+        //pack the 16 masks in order, then invert them
+        __m256i p=_mm256_permute4x64_epi64(_mm256_packs_epi32(less[0],less[1]),0xD8);
+        __m128i r=_mm_packs_epi16(_mm256_castsi256_si128(p),_mm256_extracti128_si256(p,1));
+        _mm_storeu_si128((__m128i*)(dst+x),_mm_xor_si128(r,_mm_set1_epi8(-1)));
+    }
+    return x;
+}
+#endif
+
+//instruction sets available at run time
+enum SimdLevel {SIMD_NONE,SIMD_SSE2,SIMD_SSSE3,SIMD_AVX2};
+SimdLevel getSimdLevel()
+{
+#ifdef ARUCO_FASTTHRESHOLD_X86
+    static const SimdLevel level=__builtin_cpu_supports("avx2")?SIMD_AVX2:
+                                 __builtin_cpu_supports("ssse3")?SIMD_SSSE3:
+                                 __builtin_cpu_supports("sse2")?SIMD_SSE2:SIMD_NONE;
+    return level;
+#else
+    return SIMD_NONE;
+#endif
+}
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void FastThreshold::bgrToGrey(const unsigned char *src,size_t srcStep,unsigned char *dst,size_t dstStep,int width,int height)
+{
+    for (int y=0;y<height;y++)
+    {
+        const unsigned char *s=src+y*srcStep;
+        unsigned char *d=dst+y*dstStep;
+        int x=0;
+#ifdef ARUCO_FASTTHRESHOLD_X86
+        if (getSimdLevel()>=SIMD_SSSE3)
+            x=greyRowSSSE3(s,d,width);
+#endif
+        greyRow(s,d,x,width);
+    }
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void FastThreshold::pyrDown(const unsigned char *src,size_t srcStep,int width,int height,unsigned char *dst,size_t dstStep,std::vector<int> &buffer)
+{
+    if (width<=0 || height<=0) return;
+    const int dw=(width+1)/2,dh=(height+1)/2;
+
+    //5 horizontally filtered rows kept in a ring, indexed by their unreflected source row
+    buffer.resize(5*dw);
+    int rowTag[5];
+    for (int i=0;i<5;i++) rowTag[i]=-1000;
+
+    for (int y=0;y<dh;y++)
+    {
+        const int *rows[5];
+        for (int i=0;i<5;i++)
+        {
+            int l=2*y+i-2;
+            int slot=(l+5)%5;
+            int *r=&buffer[slot*dw];
+            rows[i]=r;
+            if (rowTag[slot]==l) continue;
+            rowTag[slot]=l;
+
+            //horizontal 1 4 6 4 1 filter on source row l
+            const unsigned char *s=src+reflect101(l,height)*srcStep;
+            for (int x=0;x<dw;x++)
+            {
+                int sx=2*x;
+                if (sx>=2 && sx+2<width)
+                    r[x]=s[sx-2]+s[sx+2]+4*(s[sx-1]+s[sx+1])+6*s[sx];
+                else
+                    r[x]=s[reflect101(sx-2,width)]+s[reflect101(sx+2,width)]
+                        +4*(s[reflect101(sx-1,width)]+s[reflect101(sx+1,width)])+6*s[reflect101(sx,width)];
+            }
+        }
+
+        //vertical filter and rounding
+        unsigned char *d=dst+y*dstStep;
+        for (int x=0;x<dw;x++)
+            d[x]=(unsigned char)((rows[0][x]+rows[4][x]+4*(rows[1][x]+rows[3][x])+6*rows[2][x]+128)>>8);
+    }
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void FastThreshold::adaptiveThresholdMeanInv(const unsigned char *src,size_t srcStep,unsigned char *dst,size_t dstStep,int width,int height,
+                                             int blockSize,double delta,std::vector<int> &buffer)
+{
+    if (width<=0 || height<=0) return;
+    const int r=blockSize/2;
+    const int k2=blockSize*blockSize;
+    const int idelta=(int)std::floor(delta);
+
+    //The output is 255 where the rounded box mean is >= src+idelta. The mean sum/k2 is never halfway
+    //between two integers as k2 is odd, so this is 2*sum>=(2*(src+idelta)-1)*k2 and no division is needed.
+    //Borders are replicated as in the OpenCV box filter.
+    buffer.resize(2*width+2*r);
+    int *padded=&buffer[0];       //column sums with r replicated values on each side
+    int *col=padded+r;            //sum of the blockSize rows around the current row, for each column
+    int *box=padded+width+2*r;    //box sum of each pixel of the current row
+
+    for (int x=0;x<width;x++)
+        col[x]=(r+1)*src[x];
+    for (int dy=1;dy<=r;dy++)
+    {
+        const unsigned char *s=src+std::min(dy,height-1)*srcStep;
+        for (int x=0;x<width;x++)
+            col[x]+=s[x];
+    }
+
+    const SimdLevel simd=getSimdLevel();
+    for (int y=0;y<height;y++)
+    {
+        if (y>0)
+        {
+            const unsigned char *add=src+std::min(y+r,height-1)*srcStep;
+            const unsigned char *sub=src+std::max(y-r-1,0)*srcStep;
+            int x=0;
+#ifdef ARUCO_FASTTHRESHOLD_X86
+            if (simd>=SIMD_AVX2) x=updateColumnSumsAVX2(col,add,sub,width);
+            else if (simd>=SIMD_SSE2) x=updateColumnSumsSSE2(col,add,sub,width);
+#endif
+            updateColumnSums(col,add,sub,x,width);
+        }
+        for (int i=0;i<r;i++)
+        {
+            padded[i]=col[0];
+            col[width+i]=col[width-1];
+        }
+
+        int sum=0;
+        for (int i=0;i<=2*r;i++)
+            sum+=padded[i];
+        box[0]=sum;
+        for (int x=1;x<width;x++)
+        {
+            sum+=padded[x+2*r]-padded[x-1];
+            box[x]=sum;
+        }
+
+        const unsigned char *s=src+y*srcStep;
+        unsigned char *d=dst+y*dstStep;
+        int x=0;
+#ifdef ARUCO_FASTTHRESHOLD_X86
+        if (simd>=SIMD_AVX2) x=compareBoxSumsAVX2(box,s,d,width,2*k2,(2*idelta-1)*k2);
+        else if (simd>=SIMD_SSE2) x=compareBoxSumsSSE2(box,s,d,width,2*k2,(2*idelta-1)*k2);
+#endif
+        compareBoxSums(box,s,d,x,width,2*k2,(2*idelta-1)*k2);
+    }
+}
+
+}
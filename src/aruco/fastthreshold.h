@@ -0,0 +1,36 @@
+#ifndef _ARUCO_FastThreshold_H
+#define _ARUCO_FastThreshold_H
+#include <cstddef>
+#include <vector>
+#include "exports.h"
+
+namespace aruco
+{
+
+/**\brief Preprocessing kernels of the ADPT_THRES detection path
+ *
+ * The kernels work on raw 8 bit buffers and give exactly the same output as the OpenCV calls they replace.
+ * On x86 they use SSE2/SSSE3 or AVX2 when the cpu supports them (checked at run time), and plain C++ otherwise.
+ * The buffer argument is scratch memory, pass the same vector on successive calls to avoid reallocations.
+ */
+class ARUCO_EXPORTS FastThreshold
+{
+public:
+    /**Same as cv::cvtColor(src,dst,CV_BGR2GRAY) for 8UC3 input
+     */
+    static void bgrToGrey(const unsigned char *src,size_t srcStep,unsigned char *dst,size_t dstStep,int width,int height);
+
+    /**Same as cv::pyrDown for 8UC1 input, dst must be ((width+1)/2)x((height+1)/2)
+     */
+    static void pyrDown(const unsigned char *src,size_t srcStep,int width,int height,unsigned char *dst,size_t dstStep,std::vector<int> &buffer);
+
+    /**Same as cv::adaptiveThreshold(src,dst,255,ADAPTIVE_THRESH_MEAN_C,THRESH_BINARY_INV,blockSize,delta).
+     * The box mean and the threshold are done in a single pass over the image with running sums, the mean
+     * image is never written.
+     */
+    static void adaptiveThresholdMeanInv(const unsigned char *src,size_t srcStep,unsigned char *dst,size_t dstStep,int width,int height,
+                                         int blockSize,double delta,std::vector<int> &buffer);
+};
+
+}
+#endif
@@ -32,7 +32,12 @@ or implied, of Rafael Muñoz Salinas.
 #include <iostream>
 #include <fstream>
 #include "arucofidmarkers.h"
+#include "fastthreshold.h"
+#include "contourscanner.h"
+#include "planarpose.h"
 #include <valarray>
+#include <limits>
+#include <exception>
 
 #include <iostream>
 #include "time.h"
@@ -42,6 +47,50 @@ using namespace cv;
 
 namespace aruco
 {
+
+namespace
+{
+template<typename Body>
+class ParallelBody: public cv::ParallelLoopBody
+{
+public:
+    ParallelBody ( const Body &body,vector<std::exception_ptr> &errors ) : _body ( body ),_errors ( errors ) {}
+    void operator() ( const cv::Range &range ) const
+    {
+        //exceptions of any type must not leave the parallel loop, they are thrown again by parallelFor
+        try
+        {
+            _body ( range );
+        }
+        catch ( ... )
+        {
+            _errors[range.start]=std::current_exception();
+        }
+    }
+private:
+    const Body &_body;
+    vector<std::exception_ptr> &_errors;
+};
+
+/**Calls body with subranges of [0,n), in parallel with cv::parallel_for_ if parallel is set, in the calling thread otherwise.
+ * In parallel, the first exception in range order is thrown again as it was, as in the calling thread
+ */
+template<typename Body>
+void parallelFor ( int n,bool parallel,const Body &body )
+{
+    if ( n<=0 ) return;
+    if ( !parallel || n==1 )
+    {
+        body ( cv::Range ( 0,n ) );
+        return;
+    }
+    vector<std::exception_ptr> errors ( n );
+    cv::parallel_for_ ( cv::Range ( 0,n ),ParallelBody<Body> ( body,errors ) );
+    for ( int i=0;i<n;i++ )
+        if ( errors[i] ) std::rethrow_exception ( errors[i] );
+}
+}
+
 /************************************
  *
  *
@@ -51,6 +100,13 @@ namespace aruco
 MarkerDetector::MarkerDetector()
 {
     _doErosion=false;
+    _fastThreshold=true;
+    _planarPose=false;
+    _homographySampling=true;
+    _fastLineFit=true;
+    _parallelMarkers=true;
+    _tilesX=_tilesY=1;
+    _tileOverlap=0.1;
     _enableCylinderWarp=false;
     _thresMethod=ADPT_THRES;
     _thresParam1=_thresParam2=7;
@@ -109,24 +165,243 @@ void MarkerDetector::setDesiredSpeed ( int val )
  *
  *
  ************************************/
-void MarkerDetector::detect ( const  cv::Mat &input,std::vector<Marker> &detectedMarkers, CameraParameters camParams ,float markerSizeMeters ,bool setYPerperdicular) throw ( cv::Exception )
+void MarkerDetector::Stats::clear()
 {
-    detect ( input, detectedMarkers,camParams.CameraMatrix ,camParams.Distorsion,  markerSizeMeters ,setYPerperdicular);
+    calls=0;
+    for ( int s=0;s<NUM_STAGES;s++ )
+    {
+        time[s]=0;
+        for ( int b=0;b<NumTimeBins;b++ ) timeHist[s][b]=0;
+    }
+    contours=rejectedSize=rejectedPolygon=rejectedConvex=rejectedSide=rejectedNear=0;
+    candidates=rejectedWarp=rejectedId=identified=duplicates=rejectedTileEdge=lineFitUnrefined=0;
 }
 
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::Stats::add ( const Stats &s )
+{
+    calls+=s.calls;
+    for ( int st=0;st<NUM_STAGES;st++ )
+    {
+        time[st]+=s.time[st];
+        for ( int b=0;b<NumTimeBins;b++ ) timeHist[st][b]+=s.timeHist[st][b];
+    }
+    contours+=s.contours;
+    rejectedSize+=s.rejectedSize;
+    rejectedPolygon+=s.rejectedPolygon;
+    rejectedConvex+=s.rejectedConvex;
+    rejectedSide+=s.rejectedSide;
+    rejectedNear+=s.rejectedNear;
+    candidates+=s.candidates;
+    rejectedWarp+=s.rejectedWarp;
+    rejectedId+=s.rejectedId;
+    identified+=s.identified;
+    duplicates+=s.duplicates;
+    rejectedTileEdge+=s.rejectedTileEdge;
+    lineFitUnrefined+=s.lineFitUnrefined;
+}
 
 /************************************
  *
- * Main detection function. Performs all steps
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::Stats::addCall ( double timePreprocess,double timeFindRect,double timeIdentify,double timeReconstruction )
+{
+    double t[NUM_STAGES]={timePreprocess,timeFindRect,timeIdentify,timeReconstruction};
+    calls++;
+    for ( int s=0;s<NUM_STAGES;s++ )
+    {
+        time[s]+=t[s];
+        int b=0;
+        while ( b<NumTimeBins-1 && t[s]>=timeBinEdge ( b ) ) b++;
+        timeHist[s][b]++;
+    }
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+double MarkerDetector::Stats::timeBinEdge ( int bin )
+{
+    if ( bin>=NumTimeBins-1 ) return std::numeric_limits<double>::infinity();
+    static const double series[3]={1,2,5};
+    return series[bin%3]*1e-4*pow ( 10.,bin/3 );
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+const char *MarkerDetector::Stats::stageName ( int stage )
+{
+    static const char *names[NUM_STAGES]={"preprocess","find_rect","identify","reconstruction"};
+    if ( stage<0 || stage>=NUM_STAGES ) return "";
+    return names[stage];
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::detect ( const  cv::Mat &input,std::vector<Marker> &detectedMarkers,const CameraParameters &camParams ,float markerSizeMeters ,bool setYPerperdicular) throw ( cv::Exception )
+{
+    detect ( input, detectedMarkers,_ws,camParams,  markerSizeMeters ,setYPerperdicular);
+}
+
+/************************************
+ *
+ *
  *
  *
  ************************************/
 void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMarkers,Mat camMatrix ,Mat distCoeff ,float markerSizeMeters ,bool setYPerperdicular) throw ( cv::Exception )
 {
-	long time_init = clock();
+    detect ( input, detectedMarkers,_ws,camMatrix ,distCoeff,  markerSizeMeters ,setYPerperdicular);
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::detect ( const  cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws,const CameraParameters &camParams ,float markerSizeMeters ,bool setYPerperdicular) const throw ( cv::Exception )
+{
+    detectMarkersTiled ( input,detectedMarkers,ws );
+
+    ///detect the position of detected markers if desired
+    int64 time_init = cv::getTickCount();
+    if ( camParams.CameraMatrix.rows!=0  && markerSizeMeters>0 )
+        calculateExtrinsics ( detectedMarkers,markerSizeMeters,camParams.CameraMatrix,camParams.Distorsion,&camParams,setYPerperdicular );
+    ws.timeReconstruction+= ( cv::getTickCount()-time_init ) /cv::getTickFrequency();
+    ws.stats.addCall ( ws.timePreprocess,ws.timeFindRect,ws.timeIdentify,ws.timeReconstruction );
+}
+
+
+/************************************
+ *
+ * Main detection function. Performs all steps
+ *
+ *
+ ************************************/
+void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMarkers,Workspace &ws,Mat camMatrix ,Mat distCoeff ,float markerSizeMeters ,bool setYPerperdicular) const throw ( cv::Exception )
+{
+    detectMarkersTiled ( input,detectedMarkers,ws );
+
+    ///detect the position of detected markers if desired
+    int64 time_init = cv::getTickCount();
+    if ( camMatrix.rows!=0  && markerSizeMeters>0 )
+        calculateExtrinsics ( detectedMarkers,markerSizeMeters,camMatrix,distCoeff,NULL,setYPerperdicular );
+    ws.timeReconstruction+= ( cv::getTickCount()-time_init ) /cv::getTickFrequency();
+    ws.stats.addCall ( ws.timePreprocess,ws.timeFindRect,ws.timeIdentify,ws.timeReconstruction );
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::detect ( const  cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws,const std::vector<cv::Rect> &rois,const CameraParameters &camParams,float markerSizeMeters ,bool setYPerperdicular ) const throw ( cv::Exception )
+{
+    detectedMarkers.clear();
+
+    //clip the regions to the image and merge the ones that overlap, so that each area is processed once
+    cv::Rect imgRect ( 0,0,input.cols,input.rows );
+    vector<cv::Rect> regions;
+    for ( unsigned int i=0;i<rois.size();i++ )
+    {
+        cv::Rect r=rois[i] & imgRect;
+        if ( r.area() >0 ) regions.push_back ( r );
+    }
+    bool merged=true;
+    while ( merged )
+    {
+        merged=false;
+        for ( unsigned int i=0;i<regions.size() && !merged;i++ )
+            for ( unsigned int j=i+1;j<regions.size() && !merged;j++ )
+                if ( ( regions[i] & regions[j] ).area() >0 )
+                {
+                    regions[i]=regions[i] | regions[j];
+                    regions.erase ( regions.begin() +j );
+                    merged=true;
+                }
+    }
+
+    //each region is detected as an image of its own, but with the marker sizes relative to the whole input
+    int sizeRef=std::max ( input.cols,input.rows );
+    double timeStage[4]={0,0,0,0};
+    vector<Marker> regionMarkers;
+    for ( unsigned int i=0;i<regions.size();i++ )
+    {
+        detectMarkers ( input ( regions[i] ),regionMarkers,ws,sizeRef );
+        timeStage[0]+=ws.timePreprocess;
+        timeStage[1]+=ws.timeFindRect;
+        timeStage[2]+=ws.timeIdentify;
+        timeStage[3]+=ws.timeReconstruction;
+        for ( unsigned int m=0;m<regionMarkers.size();m++ )
+        {
+            for ( int c=0;c<4;c++ )
+            {
+                regionMarkers[m][c].x+=regions[i].x;
+                regionMarkers[m][c].y+=regions[i].y;
+            }
+            detectedMarkers.push_back ( regionMarkers[m] );
+        }
+    }
+
+    int64 time_init = cv::getTickCount();
+    //regions do not overlap, but a marker on the border of two of them might be found twice
+    std::sort ( detectedMarkers.begin(),detectedMarkers.end() );
+    removeDuplicates ( detectedMarkers,ws.stats );
+
+    if ( camParams.CameraMatrix.rows!=0  && markerSizeMeters>0 )
+        calculateExtrinsics ( detectedMarkers,markerSizeMeters,camParams.CameraMatrix,camParams.Distorsion,&camParams,setYPerperdicular );
+    ws.timePreprocess=timeStage[0];
+    ws.timeFindRect=timeStage[1];
+    ws.timeIdentify=timeStage[2];
+    ws.timeReconstruction=timeStage[3]+ ( cv::getTickCount()-time_init ) /cv::getTickFrequency();
+    ws.stats.addCall ( ws.timePreprocess,ws.timeFindRect,ws.timeIdentify,ws.timeReconstruction );
+}
 
-    //it must be a 3 channel image
-    if ( input.type() ==CV_8UC3 )   cv::cvtColor ( input,grey,CV_BGR2GRAY );
+/************************************
+ *
+ * Detection of the markers in the image, without extrinsics
+ *
+ *
+ ************************************/
+void MarkerDetector::detectMarkers ( const cv::Mat &input,vector<Marker> &detectedMarkers,Workspace &ws,int sizeRef ) const throw ( cv::Exception )
+{
+    int64 time_init = cv::getTickCount();
+
+    //scratch images are kept in the workspace to reuse their buffers
+    cv::Mat &thres=ws.thres,&thres2=ws.thres2,&reduced=ws.reduced;
+
+    //3 channel images are converted, grey images are used directly. The conversion buffer
+    //is never an alias of the input, so it can not overwrite a previous input image
+    cv::Mat grey;
+    if ( input.type() ==CV_8UC3 ) {
+        if ( _fastThreshold ) {
+            ws.grey.create ( input.size(),CV_8UC1 );
+            FastThreshold::bgrToGrey ( input.data,input.step,ws.grey.data,ws.grey.step,input.cols,input.rows );
+        }
+        else cv::cvtColor ( input,ws.grey,CV_BGR2GRAY );
+        grey=ws.grey;
+    }
     else     grey=input;
 
 
@@ -141,20 +416,34 @@ void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMark
     if ( pyrdown_level!=0 )
     {
         reduced=grey;
-        for ( int i=0;i<pyrdown_level;i++ )
-        {
-            cv::Mat tmp;
-            cv::pyrDown ( reduced,tmp );
-            reduced=tmp;
+        if ( _fastThreshold && grey.type() ==CV_8UC1 ) {
+            //the levels are kept in the workspace, so no image is allocated after the first call
+            ws.pyramid.resize ( pyrdown_level );
+            for ( int i=0;i<pyrdown_level;i++ )
+            {
+                cv::Mat &level=ws.pyramid[i];
+                level.create ( ( reduced.rows+1 ) /2, ( reduced.cols+1 ) /2,CV_8UC1 );
+                FastThreshold::pyrDown ( reduced.data,reduced.step,reduced.cols,reduced.rows,level.data,level.step,ws.buffer );
+                reduced=level;
+            }
+        }
+        else {
+            for ( int i=0;i<pyrdown_level;i++ )
+            {
+                cv::Mat tmp;
+                cv::pyrDown ( reduced,tmp );
+                reduced=tmp;
+            }
         }
         int red_den=pow ( 2.0f,pyrdown_level );
         imgToBeThresHolded=reduced;
+        sizeRef/=red_den;
         ThresParam1/=float ( red_den );
         ThresParam2/=float ( red_den );
     }
 	
     ///Do threshold the image and detect contours
-    thresHold ( _thresMethod,imgToBeThresHolded,thres,ThresParam1,ThresParam2 );
+    thresHold ( _thresMethod,imgToBeThresHolded,thres,ThresParam1,ThresParam2,ws.buffer );
     //an erosion might be required to detect chessboard like boards
 
 	
@@ -165,12 +454,13 @@ void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMark
         thres2=thres;
 //         cv::bitwise_xor ( thres,thres2,thres );
     }
-	long time_preprocess = clock();
+    int64 time_preprocess = cv::getTickCount();
 
     //find all rectangles in the thresholdes image
-    vector<MarkerCandidate > MarkerCanditates;
+    vector<MarkerCandidate > &MarkerCanditates=ws.markerCandidates;
+    MarkerCanditates.clear();
 
-    detectRectangles ( thres,MarkerCanditates );
+    detectRectangles ( thres,MarkerCanditates,ws,sizeRef );
 
     //if the image has been downsampled, then calcualte the location of the corners in the original image
     if ( pyrdown_level!=0 )
@@ -192,84 +482,298 @@ void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMark
         }
     }
 
-	long time_findrec = clock();
+    int64 time_findrec = cv::getTickCount();
 
     ///identify the markers
-    _candidates.clear();
+    ws.candidates.clear();
+    ws.stats.candidates+=MarkerCanditates.size();
+    //with the default marker function, the cells are sampled in the image instead of warping a canonical image
+    bool sampleCells=_homographySampling && !_enableCylinderWarp && grey.type() ==CV_8UC1 &&
+                     markerIdDetector_ptrfunc==static_cast<int ( * ) ( const cv::Mat &,int & ) > ( FiducidalMarkers::detect );
+    const Point2f pointsCell[4]={Point2f ( 0,0 ),Point2f ( 7,0 ),Point2f ( 7,7 ),Point2f ( 0,7 ) };
+    //each candidate is analyzed on its own, possibly in parallel, writing only its entry of identification
+    vector<Vec4i> &identification=ws.identification;
+    identification.resize ( MarkerCanditates.size() );
+    parallelFor ( MarkerCanditates.size(),_parallelMarkers && MarkerCanditates.size() >=MinParallelMarkers,[&] ( const cv::Range &range )
+    {
+        for ( int i=range.start;i<range.end;i++ )
+        {
+            //Find proyective homography
+            Mat canonicalMarker;
+            bool resW=false;
+            int nRotations=0;
+            int id=-1;
+            if ( sampleCells )
+            {
+                Point2f pointsIn[4];
+                for ( int c=0;c<4;c++ ) pointsIn[c]=MarkerCanditates[i][c];
+                id=FiducidalMarkers::detect ( grey,getPerspectiveTransform ( pointsCell,pointsIn ),nRotations );
+                resW=true;
+            }
+            else
+            {
+                if (_enableCylinderWarp)
+                    resW=warp_cylinder( grey,canonicalMarker,Size ( _markerWarpSize,_markerWarpSize ),MarkerCanditates[i] );
+                else  resW=warp ( grey,canonicalMarker,Size ( _markerWarpSize,_markerWarpSize ),MarkerCanditates[i] );
+                if ( resW ) id= ( *markerIdDetector_ptrfunc ) ( canonicalMarker,nRotations );
+            }
+            bool unrefined=false;
+            if ( resW && id!=-1 && _cornerMethod==LINES && pyrdown_level==0 ) { // make LINES refinement before lose contour points
+                if ( _fastLineFit ) unrefined=!refineCandidateLinesFast ( MarkerCanditates[i] );
+                else refineCandidateLines( MarkerCanditates[i] );
+            }
+            identification[i]=Vec4i ( resW,id,nRotations,unrefined );
+        }
+    } );
+    //the results are collected in the order of the candidates, so that they do not depend on the threads
     for ( unsigned int i=0;i<MarkerCanditates.size();i++ )
     {
-        //Find proyective homography
-        Mat canonicalMarker;
-        bool resW=false;
-        if (_enableCylinderWarp)
-            resW=warp_cylinder( grey,canonicalMarker,Size ( _markerWarpSize,_markerWarpSize ),MarkerCanditates[i] );
-        else  resW=warp ( grey,canonicalMarker,Size ( _markerWarpSize,_markerWarpSize ),MarkerCanditates[i] );
+        bool resW=identification[i][0]!=0;
+        int id=identification[i][1];
+        int nRotations=identification[i][2];
         if (resW) {
-            int nRotations;
-            int id= ( *markerIdDetector_ptrfunc ) ( canonicalMarker,nRotations );
             if ( id!=-1 )
             {
-		if(_cornerMethod==LINES) refineCandidateLines( MarkerCanditates[i] ); // make LINES refinement before lose contour points
-                detectedMarkers.push_back ( MarkerCanditates[i] );
+                if ( identification[i][3] ) ws.stats.lineFitUnrefined++;
+                detectedMarkers.push_back ( std::move ( MarkerCanditates[i] ) );
                 detectedMarkers.back().id=id;
                 //sort the points so that they are always in the same order no matter the camera orientation
                 std::rotate ( detectedMarkers.back().begin(),detectedMarkers.back().begin() +4-nRotations,detectedMarkers.back().end() );
+                ws.stats.identified++;
+            }
+            else
+            {
+                ws.candidates.push_back ( MarkerCanditates[i] );
+                ws.stats.rejectedId++;
             }
-            else _candidates.push_back ( MarkerCanditates[i] );
-        }       
+        }
+        else ws.stats.rejectedWarp++;
     }
 
-	long time_identify = clock();
+    int64 time_identify = cv::getTickCount();
 
     ///refine the corner location if desired
-    if ( detectedMarkers.size() >0 && _cornerMethod!=NONE && _cornerMethod!=LINES )
+    //the contour of a reduced image is too coarse for LINES, the corners are then refined in the full
+    //resolution image, in windows of about the size of a reduced pixel
+    bool refineReduced= ( pyrdown_level!=0 && _cornerMethod==LINES );
+    if ( detectedMarkers.size() >0 && _cornerMethod!=NONE && ( _cornerMethod!=LINES || refineReduced ) )
     {
-        vector<Point2f> Corners;
-        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
-            for ( int c=0;c<4;c++ )
-                Corners.push_back ( detectedMarkers[i][c] );
-
-        if ( _cornerMethod==HARRIS )
-            findBestCornerInRegion_harris ( grey, Corners,7 );
-        else if ( _cornerMethod==SUBPIX )
-            cornerSubPix ( grey, Corners,cvSize ( 5,5 ), cvSize ( -1,-1 )   ,cvTermCriteria ( CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,3,0.05 ) );
+        //corners are refined independently, so each range of markers can be done in parallel
+        parallelFor ( detectedMarkers.size(),_parallelMarkers && detectedMarkers.size() >=MinParallelMarkers,[&] ( const cv::Range &range )
+        {
+            vector<Point2f> Corners;
+            for ( int i=range.start;i<range.end;i++ )
+                for ( int c=0;c<4;c++ )
+                    Corners.push_back ( detectedMarkers[i][c] );
+
+            if ( _cornerMethod==HARRIS )
+                findBestCornerInRegion_harris ( grey, Corners,7 );
+            else if ( _cornerMethod==SUBPIX )
+                cornerSubPix ( grey, Corners,cvSize ( 5,5 ), cvSize ( -1,-1 )   ,cvTermCriteria ( CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,3,0.05 ) );
+            else if ( refineReduced )
+            {
+                int halfWin= ( 1<<pyrdown_level ) +1;
+                cornerSubPix ( grey, Corners,cvSize ( halfWin,halfWin ), cvSize ( -1,-1 )   ,cvTermCriteria ( CV_TERMCRIT_ITER|CV_TERMCRIT_EPS,10,0.01 ) );
+            }
 
-        //copy back
-        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
-            for ( int c=0;c<4;c++ )     detectedMarkers[i][c]=Corners[i*4+c];
+            //copy back
+            for ( int i=range.start;i<range.end;i++ )
+                for ( int c=0;c<4;c++ )     detectedMarkers[i][c]=Corners[ ( i-range.start ) *4+c];
+        } );
     }
     //sort by id
     std::sort ( detectedMarkers.begin(),detectedMarkers.end() );
     //there might be still the case that a marker is detected twice because of the double border indicated earlier,
     //detect and remove these cases
-    vector<bool> toRemove ( detectedMarkers.size(),false );
-    for ( int i=0;i<int ( detectedMarkers.size() )-1;i++ )
+    removeDuplicates ( detectedMarkers,ws.stats );
+
+    int64 time_reconstruction = cv::getTickCount();
+    double tickFreq=cv::getTickFrequency();
+    ws.timePreprocess= ( time_preprocess-time_init ) /tickFreq;
+    ws.timeFindRect= ( time_findrec-time_preprocess ) /tickFreq;
+    ws.timeIdentify= ( time_identify-time_findrec ) /tickFreq;
+    ws.timeReconstruction= ( time_reconstruction-time_identify ) /tickFreq;
+}
+
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::calculateExtrinsics ( vector<Marker> &markers,float markerSizeMeters,const Mat &camMatrix,const Mat &distCoeff,const CameraParameters *camParams,bool setYPerperdicular ) const throw ( cv::Exception )
+{
+    //the pose of each marker only depends on its corners, so ranges of markers can be done in parallel
+    parallelFor ( markers.size(),_parallelMarkers && markers.size() >=MinParallelMarkers,[&] ( const cv::Range &range )
     {
-        if ( detectedMarkers[i].id==detectedMarkers[i+1].id && !toRemove[i+1] )
+        if ( _planarPose )
         {
-            //deletes the one with smaller perimeter
-            if ( perimeter ( detectedMarkers[i] ) >perimeter ( detectedMarkers[i+1] ) ) toRemove[i+1]=true;
-            else toRemove[i]=true;
+            vector<Marker> rangeMarkers ( markers.begin() +range.start,markers.begin() +range.end );
+            if ( camParams!=NULL ) PlanarSquarePose::calculateExtrinsics ( rangeMarkers,markerSizeMeters,*camParams,setYPerperdicular );
+            else PlanarSquarePose::calculateExtrinsics ( rangeMarkers,markerSizeMeters,camMatrix,distCoeff,setYPerperdicular );
+            for ( int i=range.start;i<range.end;i++ ) markers[i]=rangeMarkers[i-range.start];
         }
-    }
-    //remove the markers marker
-    removeElements ( detectedMarkers, toRemove );
+        else if ( camParams!=NULL )
+        {
+            //the corners are undistorted with the table of camParams, so that solvePnP does not iterate the
+            //undistortion of each marker, and the pose is solved on the normalized points
+            const cv::Mat eye=cv::Mat::eye ( 3,3,CV_32F );
+            vector<Point2f> corners;
+            for ( int i=range.start;i<range.end;i++ )
+            {
+                corners=markers[i];
+                camParams->undistortPoints ( corners,markers[i] );
+                markers[i].calculateExtrinsics ( markerSizeMeters,eye,cv::Mat(),setYPerperdicular );
+                std::copy ( corners.begin(),corners.end(),markers[i].begin() );
+            }
+        }
+        else
+            for ( int i=range.start;i<range.end;i++ )
+                markers[i].calculateExtrinsics ( markerSizeMeters,camMatrix,distCoeff,setYPerperdicular );
+    } );
+}
 
-    ///detect the position of detected markers if desired
-    if ( camMatrix.rows!=0  && markerSizeMeters>0 )
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::removeDuplicates ( vector<Marker> &markers,Stats &stats ) const
+{
+    //in each run of markers with the same id, only the one with largest perimeter is kept (the last one if equal)
+    vector<bool> toRemove ( markers.size(),false );
+    for ( size_t i=0;i<markers.size(); )
     {
-        for ( unsigned int i=0;i<detectedMarkers.size();i++ )
-            detectedMarkers[i].calculateExtrinsics ( markerSizeMeters,camMatrix,distCoeff,setYPerperdicular );
+        size_t end=i+1,best=i;
+        for ( ;end<markers.size() && markers[end].id==markers[i].id;end++ )
+            if ( perimeter ( markers[end] ) >=perimeter ( markers[best] ) ) best=end;
+        for ( size_t j=i;j<end;j++ )
+            if ( j!=best ) {
+                toRemove[j]=true;
+                stats.duplicates++;
+            }
+        i=end;
     }
+    removeElements ( markers, toRemove );
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+MarkerDetector::TileWorkspaces::~TileWorkspaces()
+{
+}
 
-	long time_reconstruction = clock();
-// 	cout << " time preprocess=" << time_preprocess - time_init;
-// 	cout << " time findrec=" << time_findrec - time_preprocess;
-// 	cout << " time identify= " << time_identify - time_findrec;
-// 	cout << " time recons= " << time_reconstruction - time_identify;
-// 	cout << endl;
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::TileWorkspaces::resize ( size_t size )
+{
+    //workspaces kept are not reallocated, so their buffers are reused
+    while ( _ws.size() <size ) _ws.push_back ( std::unique_ptr<Workspace> ( new Workspace() ) );
+    _ws.resize ( size );
 }
 
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::detectMarkersTiled ( const cv::Mat &input,vector<Marker> &detectedMarkers,Workspace &ws ) const throw ( cv::Exception )
+{
+    int sizeRef=std::max ( input.cols,input.rows );
+    int numTiles=_tilesX*_tilesY;
+    if ( numTiles==1 )
+    {
+        detectMarkers ( input,detectedMarkers,ws,sizeRef );
+        return;
+    }
+
+    //the threshold differs from the one of the whole image close to the edges of a tile, and the markers crossing them are
+    //clipped, so the markers close to an edge shared with other tile are only taken from the tile that contains them completely
+    int edgeMargin=std::max ( 3,int ( _thresParam1 ) );
+    //the tiles split the image evenly, and are enlarged by the overlap on each side. The overlap is raised to the diagonal
+    //of the biggest marker (a square of the max perimeter) plus the edge margin, so that every marker found in the whole
+    //image fits completely in the tile that contains the top left corner of its bounding box
+    int maxMarkerExtent=cvCeil ( _maxSize*sizeRef*std::sqrt ( 2.f ) ) +edgeMargin;
+    int overlap=std::max ( cvCeil ( _tileOverlap*sizeRef ),maxMarkerExtent );
+    cv::Rect imgRect ( 0,0,input.cols,input.rows );
+    ws.tiles.resize ( numTiles );
+    ws.tileRects.resize ( numTiles );
+    ws.tileMarkers.resize ( numTiles );
+    for ( int ty=0;ty<_tilesY;ty++ )
+        for ( int tx=0;tx<_tilesX;tx++ )
+        {
+            int x0=tx*input.cols/_tilesX,x1= ( tx+1 ) *input.cols/_tilesX;
+            int y0=ty*input.rows/_tilesY,y1= ( ty+1 ) *input.rows/_tilesY;
+            ws.tileRects[ty*_tilesX+tx]=cv::Rect ( x0-overlap,y0-overlap,x1-x0+2*overlap,y1-y0+2*overlap ) & imgRect;
+        }
+
+    int64 time_init=cv::getTickCount();
+    parallelFor ( numTiles,true,[&] ( const cv::Range &range )
+    {
+        for ( int t=range.start;t<range.end;t++ )
+            detectMarkers ( input ( ws.tileRects[t] ),ws.tileMarkers[t],ws.tiles[t],sizeRef );
+    } );
+    int64 time_tiles=cv::getTickCount();
+
+    double timeStage[4]={0,0,0,0};
+    detectedMarkers.clear();
+    ws.candidates.clear();
+    for ( int t=0;t<numTiles;t++ )
+    {
+        const cv::Rect &r=ws.tileRects[t];
+        Workspace &tws=ws.tiles[t];
+        float minX=r.x>0?r.x+edgeMargin:-1,maxX=r.x+r.width<input.cols?r.x+r.width-1-edgeMargin:input.cols;
+        float minY=r.y>0?r.y+edgeMargin:-1,maxY=r.y+r.height<input.rows?r.y+r.height-1-edgeMargin:input.rows;
+        for ( size_t m=0;m<ws.tileMarkers[t].size();m++ )
+        {
+            Marker &marker=ws.tileMarkers[t][m];
+            bool inside=true;
+            for ( int c=0;c<4;c++ )
+            {
+                marker[c].x+=r.x;
+                marker[c].y+=r.y;
+                inside=inside && marker[c].x>minX && marker[c].x<maxX && marker[c].y>minY && marker[c].y<maxY;
+            }
+            if ( inside ) detectedMarkers.push_back ( marker );
+            else ws.stats.rejectedTileEdge++;
+        }
+        for ( size_t i=0;i<tws.candidates.size();i++ )
+        {
+            ws.candidates.push_back ( tws.candidates[i] );
+            for ( int c=0;c<4;c++ ) ws.candidates.back() [c]+=cv::Point2f ( r.x,r.y );
+        }
+        timeStage[0]+=tws.timePreprocess;
+        timeStage[1]+=tws.timeFindRect;
+        timeStage[2]+=tws.timeIdentify;
+        timeStage[3]+=tws.timeReconstruction;
+        ws.stats.add ( tws.stats );
+        tws.stats.clear();
+    }
+    //the markers in the overlaps are found in several tiles
+    std::sort ( detectedMarkers.begin(),detectedMarkers.end() );
+    removeDuplicates ( detectedMarkers,ws.stats );
+
+    //the stages run in parallel, the wall time of the tiles is split among them as their time summed over the tiles
+    double tickFreq=cv::getTickFrequency();
+    double timeTiles= ( time_tiles-time_init ) /tickFreq;
+    double timeSum=timeStage[0]+timeStage[1]+timeStage[2]+timeStage[3];
+    double scale=timeSum>0?timeTiles/timeSum:0;
+    ws.timePreprocess=timeStage[0]*scale;
+    ws.timeFindRect=timeStage[1]*scale;
+    ws.timeIdentify=timeStage[2]*scale;
+    ws.timeReconstruction=timeStage[3]*scale+ ( cv::getTickCount()-time_tiles ) /tickFreq;
+}
 
 /************************************
  *
@@ -280,43 +784,46 @@ void MarkerDetector::detect ( const  cv::Mat &input,vector<Marker> &detectedMark
 void  MarkerDetector::detectRectangles ( const cv::Mat &thres,vector<std::vector<cv::Point2f> > &MarkerCanditates )
 {
     vector<MarkerCandidate>  candidates;
-    detectRectangles(thres,candidates);
+    detectRectangles(thres,candidates,_ws,std::max(thres.cols,thres.rows));
     //create the output
     MarkerCanditates.resize(candidates.size());
     for (size_t i=0;i<MarkerCanditates.size();i++)
         MarkerCanditates[i]=candidates[i];
 }
 
-void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandidate> & OutMarkerCanditates)
+void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandidate> & OutMarkerCanditates,Workspace &ws,int sizeRef) const
 {
-	long time_detectRec = clock();
-
     vector<MarkerCandidate>  MarkerCanditates;
     //calcualte the min_max contour sizes
-    int minSize=_minSize*std::max(thresImg.cols,thresImg.rows)*4;
-    int maxSize=_maxSize*std::max(thresImg.cols,thresImg.rows)*4;
-    std::vector<std::vector<cv::Point> > contours2;
-    std::vector<cv::Vec4i> hierarchy2;
-
-    thresImg.copyTo ( thres2 );
-
-    cv::findContours ( thres2 , contours2, hierarchy2,CV_RETR_TREE, CV_CHAIN_APPROX_NONE );	
-
-    vector<Point>  approxCurve;
+    int minSize=_minSize*sizeRef*4;
+    int maxSize=_maxSize*sizeRef*4;
+    std::vector<cv::Point> &contour=ws.contour;
+    std::vector<cv::Point> &approxCurve=ws.approxCurve;
+    cv::Mat &thres2=ws.thres2;
+
+    //the image is padded with a zero border, as cv::findContours does, so that the contours touching the image border
+    //are kept
+    cv::copyMakeBorder ( thresImg,thres2,1,1,1,1,cv::BORDER_CONSTANT,cv::Scalar ( 0 ) );
+
+    //the contours are traced one at a time without hierarchy, and only the points of the ones in the size window are
+    //stored. The contours of the candidates are moved into them, not copied
+    ContourScanner scanner;
+    scanner.start ( thres2.data,thres2.step,thres2.cols,thres2.rows,cv::Point ( -1,-1 ) );
+    int numContours=0,contourSize;
     ///for each contour, analyze if it is a paralelepiped likely to be the marker	
-    for ( unsigned int i=0;i<contours2.size();i++ )
+    for ( ; ( contourSize=scanner.next ( contour,minSize,maxSize ) ) >0;numContours++ )
     {
         //check it is a possible element by first checking is has enough points
-        if ( minSize< contours2[i].size() &&contours2[i].size()<maxSize  )
+        if ( minSize< contourSize &&contourSize<maxSize  )
         {
             //approximate to a poligon
-            approxPolyDP (  contours2[i]  ,approxCurve , double ( contours2[i].size() ) *0.05 , true );
+            approxPolyDP (  contour  ,approxCurve , double ( contour.size() ) *0.05 , true );
             // 				drawApproxCurve(copy,approxCurve,Scalar(0,0,255));
             //check that the poligon has 4 points
             if ( approxCurve.size() ==4 )
             {
 
-//  	   drawContour(input,contours2[i],Scalar(255,0,225));
+//  	   drawContour(input,contour,Scalar(255,0,225));
 //  		  namedWindow("input");
 //  		imshow("input",input);
 //  	 	waitKey(0);
@@ -339,16 +846,26 @@ void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandi
                         //add the points
                         // 	      cout<<"ADDED"<<endl;
                         MarkerCanditates.push_back ( MarkerCandidate() );
-                        MarkerCanditates.back().idx=i;
+                        MarkerCanditates.back().idx=numContours;
                         for ( int j=0;j<4;j++ )
                         {
                             MarkerCanditates.back().push_back ( Point2f ( approxCurve[j].x,approxCurve[j].y ) );
                         }
+                        MarkerCanditates.back().contour.swap ( contour );
                     }
+                    else ws.stats.rejectedSide++;
                 }
+                else ws.stats.rejectedConvex++;
             }
+            else ws.stats.rejectedPolygon++;
         }
+        else ws.stats.rejectedSize++;
     }
+    ws.stats.contours+=numContours;
+    //the scanner finds the contours in the reverse order of cv::findContours, the candidates are reversed so that the
+    //results do not change
+    std::reverse ( MarkerCanditates.begin(),MarkerCanditates.end() );
+    for ( size_t i=0;i<MarkerCanditates.size();i++ ) MarkerCanditates[i].idx=numContours-1-MarkerCanditates[i].idx;
 
 // 		 		  namedWindow("input");
 //  		imshow("input",input);
@@ -379,21 +896,43 @@ void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandi
     /// remove these elements whise corners are too close to each other
     //first detect candidates
 
+    //two candidates are too near if the average distance of their corners is below 10, so the distance of
+    //their first corners is below 40. Candidates are bucketed by the first corner in a grid of cells larger
+    //than that, and each one is only compared to the candidates in its own and the 8 neighbour cells
+    const float nearCellSize=64;
+    vector<Vec3i> nearCells ( MarkerCanditates.size() ); //cell y, cell x, candidate index
+    for ( unsigned int i=0;i<MarkerCanditates.size();i++ )
+        nearCells[i]=Vec3i ( cvFloor ( MarkerCanditates[i][0].y/nearCellSize ),cvFloor ( MarkerCanditates[i][0].x/nearCellSize ),i );
+    struct CellLess {
+        bool operator() ( const Vec3i &a,const Vec3i &b ) const {
+            return a[0]<b[0] || ( a[0]==b[0] && ( a[1]<b[1] || ( a[1]==b[1] && a[2]<b[2] ) ) );
+        }
+    };
+    std::sort ( nearCells.begin(),nearCells.end(),CellLess() );
+
     vector<pair<int,int>  > TooNearCandidates;
     for ( unsigned int i=0;i<MarkerCanditates.size();i++ )
     {
         // 	cout<<"Marker i="<<i<<MarkerCanditates[i]<<endl;
-        //calculate the average distance of each corner to the nearest corner of the other marker candidate
-        for ( unsigned int j=i+1;j<MarkerCanditates.size();j++ )
+        int cy=cvFloor ( MarkerCanditates[i][0].y/nearCellSize ),cx=cvFloor ( MarkerCanditates[i][0].x/nearCellSize );
+        for ( int ny=cy-1;ny<=cy+1;ny++ )
         {
-            float dist=0;
-            for ( int c=0;c<4;c++ )
-                dist+= sqrt ( ( MarkerCanditates[i][c].x-MarkerCanditates[j][c].x ) * ( MarkerCanditates[i][c].x-MarkerCanditates[j][c].x ) + ( MarkerCanditates[i][c].y-MarkerCanditates[j][c].y ) * ( MarkerCanditates[i][c].y-MarkerCanditates[j][c].y ) );
-            dist/=4;
-            //if distance is too small
-            if ( dist< 10 )
+            //the 3 cells of a row are contiguous in the sorted vector
+            vector<Vec3i>::const_iterator it=std::lower_bound ( nearCells.begin(),nearCells.end(),Vec3i ( ny,cx-1,0 ),CellLess() );
+            for ( ;it!=nearCells.end() && ( *it ) [0]==ny && ( *it ) [1]<=cx+1;++it )
             {
-                TooNearCandidates.push_back ( pair<int,int> ( i,j ) );
+                unsigned int j= ( *it ) [2];
+                if ( j<=i ) continue;
+                //calculate the average distance of each corner to the nearest corner of the other marker candidate
+                float dist=0;
+                for ( int c=0;c<4;c++ )
+                    dist+= sqrt ( ( MarkerCanditates[i][c].x-MarkerCanditates[j][c].x ) * ( MarkerCanditates[i][c].x-MarkerCanditates[j][c].x ) + ( MarkerCanditates[i][c].y-MarkerCanditates[j][c].y ) * ( MarkerCanditates[i][c].y-MarkerCanditates[j][c].y ) );
+                dist/=4;
+                //if distance is too small
+                if ( dist< 10 )
+                {
+                    TooNearCandidates.push_back ( pair<int,int> ( i,j ) );
+                }
             }
         }
     }
@@ -406,6 +945,8 @@ void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandi
             toRemove[TooNearCandidates[i].second]=true;
         else toRemove[TooNearCandidates[i].first]=true;
     }
+    for ( size_t i=0;i<toRemove.size();i++ )
+        if ( toRemove[i] ) ws.stats.rejectedNear++;
 
     //remove the invalid ones
 //     removeElements ( MarkerCanditates,toRemove );
@@ -413,13 +954,11 @@ void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandi
     OutMarkerCanditates.reserve(MarkerCanditates.size());
     for (size_t i=0;i<MarkerCanditates.size();i++) {
         if (!toRemove[i]) {
-            OutMarkerCanditates.push_back(MarkerCanditates[i]);
-            OutMarkerCanditates.back().contour=contours2[ MarkerCanditates[i].idx];
+            OutMarkerCanditates.push_back(std::move(MarkerCanditates[i]));
             if (swapped[i] && _enableCylinderWarp )//if the corners where swapped, it is required to reverse here the points so that they are in the same order
                 reverse(OutMarkerCanditates.back().contour.begin(),OutMarkerCanditates.back().contour.end());//????
         }
     }
-	//cout << "Time Detect Rec: " << clock() - time_detectRec << endl;
 }
 
 /************************************
@@ -428,7 +967,18 @@ void MarkerDetector::detectRectangles(const cv::Mat &thresImg,vector<MarkerCandi
  *
  *
  ************************************/
-void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double param1,double param2 ) throw ( cv::Exception )
+void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double param1,double param2 ) const throw ( cv::Exception )
+{
+    std::vector<int> buffer;
+    thresHold ( method,grey,out,param1,param2,buffer );
+}
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double param1,double param2,std::vector<int> &buffer ) const throw ( cv::Exception )
 {
 
     if (param1==-1) param1=_thresParam1;
@@ -445,7 +995,13 @@ void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double para
 //ensure that _thresParam1%2==1
         if ( param1<3 ) param1=3;
         else if ( ( ( int ) param1 ) %2 !=1 ) param1= ( int ) ( param1+1 );		
-        cv::adaptiveThreshold ( grey,out,255,ADAPTIVE_THRESH_MEAN_C,THRESH_BINARY_INV,param1,param2 );
+        if ( _fastThreshold ) {
+            //box mean and threshold in a single pass, the output can not share data with the input
+            if ( out.data==grey.data ) out.release();
+            out.create ( grey.size(),CV_8UC1 );
+            FastThreshold::adaptiveThresholdMeanInv ( grey.data,grey.step,out.data,out.step,grey.cols,grey.rows,int ( param1 ),param2,buffer );
+        }
+        else cv::adaptiveThreshold ( grey,out,255,ADAPTIVE_THRESH_MEAN_C,THRESH_BINARY_INV,param1,param2 );
         break;
     case CANNY:
     {
@@ -469,7 +1025,7 @@ void MarkerDetector::thresHold ( int method,const Mat &grey,Mat &out,double para
  *
  *
  ************************************/
-bool MarkerDetector::warp ( Mat &in,Mat &out,Size size, vector<Point2f> points ) throw ( cv::Exception )
+bool MarkerDetector::warp ( const Mat &in,Mat &out,Size size, vector<Point2f> points ) const throw ( cv::Exception )
 {
 
     if ( points.size() !=4 )    throw cv::Exception ( 9001,"point.size()!=4","MarkerDetector::warp",__FILE__,__LINE__ );
@@ -573,7 +1129,7 @@ void setPointIntoImage(cv::Point  &p,cv::Size s) {
  *
  *
  ************************************/
-bool MarkerDetector::warp_cylinder ( Mat &in,Mat &out,Size size, MarkerCandidate& mcand ) throw ( cv::Exception )
+bool MarkerDetector::warp_cylinder ( const Mat &in,Mat &out,Size size, MarkerCandidate& mcand ) const throw ( cv::Exception )
 {
 
     if ( mcand.size() !=4 )    throw cv::Exception ( 9001,"point.size()!=4","MarkerDetector::warp",__FILE__,__LINE__ );
@@ -716,7 +1272,7 @@ return true;
  *
  *
  ************************************/
-bool MarkerDetector::isInto ( Mat &contour,vector<Point2f> &b )
+bool MarkerDetector::isInto ( Mat &contour,vector<Point2f> &b ) const
 {
 
     for ( unsigned int i=0;i<b.size();i++ )
@@ -729,7 +1285,7 @@ bool MarkerDetector::isInto ( Mat &contour,vector<Point2f> &b )
  *
  *
  ************************************/
-int MarkerDetector:: perimeter ( vector<Point2f> &a )
+int MarkerDetector:: perimeter ( vector<Point2f> &a ) const
 {
     int sum=0;
     for ( unsigned int i=0;i<a.size();i++ )
@@ -745,7 +1301,7 @@ int MarkerDetector:: perimeter ( vector<Point2f> &a )
  *
  *
  */
-void MarkerDetector::findBestCornerInRegion_harris ( const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize )
+void MarkerDetector::findBestCornerInRegion_harris ( const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize ) const
 {
     int halfSize=blockSize/2;
     for ( size_t i=0;i<Corners.size();i++ )
@@ -781,7 +1337,7 @@ void MarkerDetector::findBestCornerInRegion_harris ( const cv::Mat  & grey,vecto
  *
  *
  */
-void MarkerDetector::refineCandidateLines(MarkerDetector::MarkerCandidate& candidate)
+void MarkerDetector::refineCandidateLines(MarkerDetector::MarkerCandidate& candidate) const
 {
       // search corners on the contour vector
       vector<unsigned int> cornerIndex;
@@ -836,9 +1392,113 @@ void MarkerDetector::refineCandidateLines(MarkerDetector::MarkerCandidate& candi
 }
 
 
+/**
+ * The sides are fitted with the same parametrization as interpolate2Dline, y=ax+c if the side is wider than high
+ * and x=by+c otherwise, but in closed form from the sums of the coordinates. Long sides are subsampled so that
+ * the cost per marker is bounded
+ */
+bool MarkerDetector::refineCandidateLinesFast(MarkerDetector::MarkerCandidate& candidate) const
+{
+    const vector<Point> &contour=candidate.contour;
+    int n=contour.size();
+    // search corners on the contour vector, they are contour points so their coordinates are integer
+    Point corners[4];
+    for ( int k=0;k<4;k++ )
+    {
+        corners[k]=Point ( cvRound ( candidate[k].x ),cvRound ( candidate[k].y ) );
+        if ( corners[k].x!=candidate[k].x || corners[k].y!=candidate[k].y ) return false;
+    }
+    int cornerIndex[4]={-1,-1,-1,-1};
+    //without branches, this is the only loop over all the contour points
+    for ( int j=0;j<n;j++ )
+        for ( int k=0;k<4;k++ )
+        {
+            bool found= ( contour[j].x==corners[k].x ) & ( contour[j].y==corners[k].y );
+            cornerIndex[k]=found?j:cornerIndex[k];
+        }
+    for ( int k=0;k<4;k++ )
+        if ( cornerIndex[k]<0 ) return false;
+
+    // contour pixel in inverse order or not?
+    bool inverse;
+    if ( ( cornerIndex[1]>cornerIndex[0] ) && ( cornerIndex[2]>cornerIndex[1] || cornerIndex[2]<cornerIndex[0] ) )
+        inverse=false;
+    else if ( cornerIndex[2]>cornerIndex[1] && cornerIndex[2]<cornerIndex[0] )
+        inverse=false;
+    else inverse=true;
+    int inc=inverse?-1:1;
+
+    // fit each side as a*x+b*y+c=0
+    int maxPoints=LineFitMaxPoints;
+    double lines[4][3];
+    for ( int l=0;l<4;l++ )
+    {
+        //points from this corner to the next one, the next one excluded
+        int len= ( ( cornerIndex[ ( l+1 ) %4]-cornerIndex[l] ) *inc+n ) %n;
+        if ( len<2 ) return false;
+        int num=std::min ( len,maxPoints );
+        //coordinates relative to the first point, so that the sums do not lose precision
+        const Point &p0=contour[cornerIndex[l]];
+        double sx=0,sy=0,sxx=0,syy=0,sxy=0;
+        int minX=0,maxX=0,minY=0,maxY=0;
+        //the i-th point is the floor(i*len/num)-th of the side, the index is advanced without divisions
+        int j=cornerIndex[l],step=inc* ( len/num ),rem=len%num,acc=0;
+        for ( int i=0;i<num;i++ )
+        {
+            const Point &p=contour[j];
+            j+=step;
+            acc+=rem;
+            if ( acc>=num ) {
+                acc-=num;
+                j+=inc;
+            }
+            if ( j>=n ) j-=n;
+            else if ( j<0 ) j+=n;
+            int x=p.x-p0.x,y=p.y-p0.y;
+            sx+=x;sy+=y;
+            sxx+=x*x;syy+=y*y;sxy+=x*y;
+            minX=std::min ( minX,x );maxX=std::max ( maxX,x );
+            minY=std::min ( minY,y );maxY=std::max ( maxY,y );
+        }
+        double mx=sx/num,my=sy/num;
+        double cxx=sxx-sx*mx,cyy=syy-sy*my,cxy=sxy-sx*my;
+        if ( maxX-minX>maxY-minY )
+        {
+            // Ax + C = y
+            if ( cxx<=0 ) return false;
+            double a=cxy/cxx;
+            lines[l][0]=a;
+            lines[l][1]=-1;
+            lines[l][2]=my-a*mx+p0.y-a*p0.x;
+        }
+        else
+        {
+            // By + C = x
+            if ( cyy<=0 ) return false;
+            double b=cxy/cyy;
+            lines[l][0]=-1;
+            lines[l][1]=b;
+            lines[l][2]=mx-b*my+p0.x-b*p0.y;
+        }
+    }
+
+    // get cross points of consecutive lines
+    Point2f crossPoints[4];
+    for ( int i=0;i<4;i++ )
+    {
+        const double *l1=lines[ ( i+3 ) %4],*l2=lines[i];
+        double det=l1[0]*l2[1]-l1[1]*l2[0];
+        if ( std::fabs ( det ) <1e-9 ) return false;
+        crossPoints[i]=Point2f ( ( l1[1]*l2[2]-l1[2]*l2[1] ) /det, ( l1[2]*l2[0]-l1[0]*l2[2] ) /det );
+    }
+    for ( int j=0;j<4;j++ )
+        candidate[j]=crossPoints[j];
+    return true;
+}
+
 /**
  */
-void MarkerDetector::interpolate2Dline( const std::vector< Point >& inPoints, Point3f& outLine)
+void MarkerDetector::interpolate2Dline( const std::vector< Point >& inPoints, Point3f& outLine) const
 {
   
   float minX, maxX, minY, maxY;
@@ -893,7 +1553,7 @@ void MarkerDetector::interpolate2Dline( const std::vector< Point >& inPoints, Po
 
 /**
  */
-Point2f MarkerDetector::getCrossPoint(const cv::Point3f& line1, const cv::Point3f& line2)
+Point2f MarkerDetector::getCrossPoint(const cv::Point3f& line1, const cv::Point3f& line2) const
 {
   
     // create matrices of equation system
@@ -1025,5 +1685,23 @@ void MarkerDetector::setMinMaxSize(float min ,float max )throw(cv::Exception)
     _maxSize=max;
 }
 
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void MarkerDetector::setTiling(int tilesX,int tilesY,float overlap)throw(cv::Exception)
+{
+    if (tilesX<1 || tilesY<1) throw cv::Exception(1," number of tiles out of range","MarkerDetector::setTiling",__FILE__,__LINE__);
+    if (overlap<0 || overlap>=1) throw cv::Exception(1," overlap parameter out of range","MarkerDetector::setTiling",__FILE__,__LINE__);
+    if (tilesX*tilesY>1 && overlap<_maxSize*std::sqrt(2.f))
+        cerr<<"MarkerDetector::setTiling . The overlap "<<overlap<<" is below the diagonal of the max marker size "<<_maxSize
+            <<", the tiles are enlarged to fit the biggest markers"<<endl;
+    _tilesX=tilesX;
+    _tilesY=tilesY;
+    _tileOverlap=overlap;
+}
+
 };
 
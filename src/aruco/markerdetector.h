@@ -30,6 +30,7 @@ or implied, of Rafael Muñoz Salinas.
 #include <opencv2/opencv.hpp>
 #include <cstdio>
 #include <iostream>
+#include <memory>
 #include "cameraparameters.h"
 #include "exports.h"
 #include "marker.h"
@@ -52,10 +53,22 @@ class ARUCO_EXPORTS  MarkerDetector
       contour=M.contour;
       idx=M.idx;
     }
+    //the move only swaps the contour, it is noexcept so that vectors of candidates use it when they grow
+    MarkerCandidate(MarkerCandidate &&M) noexcept: Marker(M){
+      contour.swap(M.contour);
+      idx=M.idx;
+    }
     MarkerCandidate & operator=(const  MarkerCandidate &M){
       (*(Marker*)this)=(*(Marker*)&M);
       contour=M.contour;
       idx=M.idx;
+      return *this;
+    }
+    MarkerCandidate & operator=(MarkerCandidate &&M) noexcept{
+      (*(Marker*)this)=(*(Marker*)&M);
+      contour.swap(M.contour);
+      idx=M.idx;
+      return *this;
     }
     
     vector<cv::Point> contour;//all the points of its contour
@@ -63,6 +76,100 @@ class ARUCO_EXPORTS  MarkerDetector
   };
 public:
 
+    /**Statistics of the detection calls made with a workspace. They are accumulated until clear() is called,
+     * and the statistics of several workspaces can be merged with add()
+     */
+    struct Stats {
+        enum Stage {PREPROCESS=0,FIND_RECT,IDENTIFY,RECONSTRUCTION,NUM_STAGES};
+        //bins of the time histograms, see timeBinEdge
+        static const int NumTimeBins=14;
+
+        //number of detection calls
+        long calls;
+        //wall time in seconds of each stage summed over the calls, and histogram of the time of each call
+        double time[NUM_STAGES];
+        long timeHist[NUM_STAGES][NumTimeBins];
+        //contours traced in the thresholded images
+        long contours;
+        //contours rejected by detectRectangles because of their number of points, because they are not approximated
+        //by a 4 sides polygon, because it is not convex and because it has a too short side
+        long rejectedSize,rejectedPolygon,rejectedConvex,rejectedSide;
+        //rectangles removed because another one with larger perimeter has the corners too near
+        long rejectedNear;
+        //rectangles passed to the identification
+        long candidates;
+        //candidates that could not be warped, and candidates with no valid id
+        long rejectedWarp,rejectedId;
+        //candidates with a valid id
+        long identified;
+        //markers removed because another one with the same id and larger perimeter was found
+        long duplicates;
+        //markers removed because they touch the edge of a tile shared with another one, see setTiling
+        long rejectedTileEdge;
+        //markers whose corners were not refined by the fast LINES fit, because a side or a corner is degenerate
+        long lineFitUnrefined;
+
+        Stats(){clear();}
+        void clear();
+        //adds the statistics of other workspace
+        void add(const Stats &s);
+        //adds a call with the stage times (seconds) passed
+        void addCall(double timePreprocess,double timeFindRect,double timeIdentify,double timeReconstruction);
+        //upper edge in seconds of a bin of the time histograms, infinity for the last one. The edges follow
+        //the 1-2-5 series from 0.1ms to 1s
+        static double timeBinEdge(int bin);
+        //name of a stage, as "preprocess"
+        static const char *stageName(int stage);
+    };
+
+    struct Workspace;
+    /**Workspaces of the tiles of a Workspace. They are held by pointer, since Workspace is not complete where it is
+     * declared. They are only scratch data, so copies start without them
+     */
+    class TileWorkspaces {
+    public:
+        TileWorkspaces(){}
+        TileWorkspaces(const TileWorkspaces &){}
+        TileWorkspaces &operator=(const TileWorkspaces &){return *this;}
+        ~TileWorkspaces();
+        void resize(size_t size);
+        size_t size()const{return _ws.size();}
+        Workspace &operator[](size_t i){return *_ws[i];}
+    private:
+        std::vector<std::unique_ptr<Workspace> > _ws;
+    };
+
+    /**Scratch data of a detection call. Buffers are kept between calls, so passing the same workspace to
+     * successive calls avoids reallocations. A workspace must only be used by one thread at a time, but a
+     * configured detector can be shared by several threads, each one with its own workspace.
+     */
+    struct Workspace {
+        //grey conversion of color input, reduced image and thresholded images
+        cv::Mat grey,thres,thres2,reduced;
+        //levels of the reduced image and scratch memory of the preprocessing kernels
+        std::vector<cv::Mat> pyramid;
+        std::vector<int> buffer;
+        //wall time in seconds of each stage of the last detection
+        double timePreprocess,timeFindRect,timeIdentify,timeReconstruction;
+        //rectangles found in the thresholded image
+        vector<MarkerCandidate> markerCandidates;
+        //vector of candidates to be markers that have no valid id
+        vector<std::vector<cv::Point2f> > candidates;
+        //contour being analyzed and its polygonal approximation
+        std::vector<cv::Point> contour,approxCurve;
+        //result of the identification of each candidate: warped, id, rotations and whether the fast LINES fit
+        //left its corners unrefined
+        std::vector<cv::Vec4i> identification;
+        //statistics of all the calls made with this workspace
+        Stats stats;
+        //workspaces, regions and markers of the tiles, see setTiling
+        TileWorkspaces tiles;
+        std::vector<cv::Rect> tileRects;
+        std::vector<std::vector<Marker> > tileMarkers;
+
+        Workspace():timePreprocess(0),timeFindRect(0),timeIdentify(0),timeReconstruction(0){}
+    };
+
     /**
      * See 
      */
@@ -94,7 +201,31 @@ public:
      * @param markerSizeMeters size of the marker sides expressed in meters
      * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
      */
-    void detect(const cv::Mat &input,std::vector<Marker> &detectedMarkers, CameraParameters camParams,float markerSizeMeters=-1,bool setYPerperdicular=true) throw (cv::Exception);
+    void detect(const cv::Mat &input,std::vector<Marker> &detectedMarkers,const CameraParameters &camParams,float markerSizeMeters=-1,bool setYPerperdicular=true) throw (cv::Exception);
+    /**Reentrant version of detect. The scratch data is kept in the workspace passed, so this method can be called
+     * concurrently as long as each thread uses its own workspace.
+     *
+     * @param input input color or grey image
+     * @param detectedMarkers output vector with the markers detected
+     * @param ws workspace of the calling thread
+     * @param camMatrix intrinsic camera information.
+     * @param distCoeff camera distorsion coefficient. If set Mat() if is assumed no camera distorion
+     * @param markerSizeMeters size of the marker sides expressed in meters
+     * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
+     */
+    void detect(const cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws,cv::Mat camMatrix=cv::Mat(),cv::Mat distCoeff=cv::Mat(),float markerSizeMeters=-1,bool setYPerperdicular=true) const throw (cv::Exception);
+    /**Reentrant version of detect, see above
+     */
+    void detect(const cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws,const CameraParameters &camParams,float markerSizeMeters=-1,bool setYPerperdicular=true) const throw (cv::Exception);
+    /**Detects the markers only inside the regions of interest passed, when their location is roughly known.
+     * Overlapping regions are merged and each region is processed as an image of its own, so the
+     * contour work is proportional to the area searched. The min and max marker sizes are still relative
+     * to the whole input, and the corners of the markers are given in input coordinates.
+     *
+     * @param rois regions of the input to search, they are clipped to the image
+     * Other parameters as in the method above. The candidates left in the workspace are in region coordinates
+     */
+    void detect(const cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws,const std::vector<cv::Rect> &rois,const CameraParameters &camParams,float markerSizeMeters=-1,bool setYPerperdicular=true) const throw (cv::Exception);
 
     /**This set the type of thresholding methods available
      */
@@ -139,7 +270,7 @@ public:
      * the parameters
      */
     const cv::Mat & getThresholdedImage() {
-        return thres;
+        return _ws.thres;
     }
     /**Methods for corner refinement
      */
@@ -167,13 +298,77 @@ public:
      * @param max output size of the contour to consider a possible marker as valid [0,1)
      * 
      */
-    void getMinMaxSize(float &min,float &max){min=_minSize;max=_maxSize;}
+    void getMinMaxSize(float &min,float &max)const{min=_minSize;max=_maxSize;}
+
+    /**Splits the images in tilesX x tilesY tiles that are detected in parallel (cv::parallel_for_), so that the time of a single
+     * high resolution image scales with the number of cores. The tiles are enlarged by the overlap on each side, and the markers
+     * that touch the edge of a tile shared with another one are only taken from the tile that contains them completely, so the
+     * overlap must be larger than the biggest marker expected. The overlap employed is raised to fit the markers of the max
+     * size of setMinMaxSize (a warning is printed here if it is below), so the markers found are the same as without tiling.
+     * The markers found in several tiles are merged.
+     * The thresholded image of the workspace is not built in this mode. By default, there is one tile (no tiling)
+     * @param tilesX number of tiles in the horizontal direction
+     * @param tilesY number of tiles in the vertical direction
+     * @param overlap overlap of the tiles as a fraction of the image size, i.e., the maximum of cols and rows [0,1)
+     */
+    void setTiling(int tilesX=1,int tilesY=1,float overlap=0.1)throw(cv::Exception);
+    /**reads the tiling employed
+     */
+    void getTiling(int &tilesX,int &tilesY,float &overlap)const{tilesX=_tilesX;tilesY=_tilesY;overlap=_tileOverlap;}
     
     /**Enables/Disables erosion process that is REQUIRED for chessboard like boards.
      * By default, this property is enabled
      */
     void enableErosion(bool enable){_doErosion=enable;}
 
+    /**Enables/Disables the fused preprocessing kernels (grey conversion, pyrdown and adaptive threshold).
+     * They give the same result as the OpenCV functions, but avoid intermediate images and use SIMD when available.
+     * By default, this property is enabled
+     */
+    void enableFastThreshold(bool enable){_fastThreshold=enable;}
+    /**
+     */
+    bool isFastThresholdEnabled()const{return _fastThreshold;}
+
+    /**Enables/Disables the closed form pose of the markers (see PlanarSquarePose) instead of solvePnP for each marker.
+     * The tool check_planarpose compares both on synthetic poses. By default, this property is disabled
+     */
+    void enablePlanarPose(bool enable){_planarPose=enable;}
+    /**
+     */
+    bool isPlanarPoseEnabled()const{return _planarPose;}
+
+    /**Enables/Disables the identification of the default markers by sampling their cells through the homography,
+     * instead of warping a canonical image of _markerWarpSize pixels. Only employed with the default marker function
+     * and without cylinder warp. By default, this property is enabled
+     */
+    void enableHomographySampling(bool enable){_homographySampling=enable;}
+    /**
+     */
+    bool isHomographySamplingEnabled()const{return _homographySampling;}
+
+    /**Enables/Disables the closed form fit of the sides in the LINES refinement, with at most LineFitMaxPoints
+     * points of each side, evenly spaced, instead of a SVD least squares over all its contour points.
+     * By default, this property is enabled
+     */
+    void enableFastLineFit(bool enable){_fastLineFit=enable;}
+    /**
+     */
+    bool isFastLineFitEnabled()const{return _fastLineFit;}
+    //maximum number of contour points of a side employed by the fast LINES refinement
+    static const int LineFitMaxPoints=128;
+
+    /**Enables/Disables the identification of the candidates, the corner refinement and the extrinsics of the markers
+     * of a frame in parallel, with cv::parallel_for_. The result does not depend on it. The function set with
+     * setMakerDetectorFunction must then be reentrant. By default, this property is enabled
+     */
+    void enableParallelMarkers(bool enable){_parallelMarkers=enable;}
+    /**
+     */
+    bool isParallelMarkersEnabled()const{return _parallelMarkers;}
+    //minimum number of candidates or markers to process them in parallel
+    static const int MinParallelMarkers=8;
+
     /**
      * Specifies a value to indicate the required speed for the internal processes. If you need maximum speed (at the cost of a lower detection rate),
      * use the value 3, If you rather a more precise and slow detection, set it to 0.
@@ -209,11 +404,15 @@ public:
 
     /** Use an smaller version of the input image for marker detection. 
      * If your marker is small enough, you can employ an smaller image to perform the detection without noticeable reduction in the precision.
-     * Internally, we are performing a pyrdown operation
+     * Internally, we are performing a pyrdown operation. With the LINES corner method, the corners found
+     * in the reduced image are refined with cornerSubPix in the full resolution image
      * 
      * @param level number of times the image size is divided by 2. Internally, we are performing a pyrdown.
      */
     void pyrDown(unsigned int level){pyrdown_level=level;}
+    /**Returns the number of pyrdown operations applied before detection
+     */
+    unsigned int getPyrDownLevel()const{return pyrdown_level;}
 
     ///-------------------------------------------------
     /// Methods you may not need
@@ -223,7 +422,7 @@ public:
     /**
      * Thesholds the passed image with the specified method.
      */
-    void thresHold(int method,const cv::Mat &grey,cv::Mat &thresImg,double param1=-1,double param2=-1)throw(cv::Exception);
+    void thresHold(int method,const cv::Mat &grey,cv::Mat &thresImg,double param1=-1,double param2=-1)const throw(cv::Exception);
     /**
     * Detection of candidates to be markers, i.e., rectangles.
     * This function returns in candidates all the rectangles found in a thresolded image
@@ -233,7 +432,7 @@ public:
     /**Returns a list candidates to be markers (rectangles), for which no valid id was found after calling detectRectangles
      */
     const vector<std::vector<cv::Point2f> > &getCandidates() {
-        return _candidates;
+        return _ws.candidates;
     }
 
     /**Given the iput image with markers, creates an output image with it in the canonical position
@@ -243,14 +442,20 @@ public:
      * @param points 4 corners of the marker in the image in
      * @return true if the operation succeed
      */
-    bool warp(cv::Mat &in,cv::Mat &out,cv::Size size, std::vector<cv::Point2f> points)throw (cv::Exception);
+    bool warp(const cv::Mat &in,cv::Mat &out,cv::Size size, std::vector<cv::Point2f> points)const throw (cv::Exception);
     
     
     
     /** Refine MarkerCandidate Corner using LINES method
      * @param candidate candidate to refine corners
      */
-    void refineCandidateLines(MarkerCandidate &candidate);    
+    void refineCandidateLines(MarkerCandidate &candidate)const;    
+    /** Same as refineCandidateLines, but each side is fitted in closed form with at most LineFitMaxPoints points
+     * @param candidate candidate to refine corners
+     * @return false if the corners are left unrefined, because the corners are not found in the contour, a side is
+     * too short or degenerate, or two consecutive sides are parallel
+     */
+    bool refineCandidateLinesFast(MarkerCandidate &candidate)const;
     
     
     /**DEPRECATED!!! Use the member function in CameraParameters
@@ -271,12 +476,24 @@ public:
 private:
 
     bool _enableCylinderWarp;
-    bool warp_cylinder ( cv::Mat &in,cv::Mat &out,cv::Size size, MarkerCandidate& mc ) throw ( cv::Exception );
+    bool warp_cylinder ( const cv::Mat &in,cv::Mat &out,cv::Size size, MarkerCandidate& mc ) const throw ( cv::Exception );
     /**
     * Detection of candidates to be markers, i.e., rectangles.
     * This function returns in candidates all the rectangles found in a thresolded image
     */
-    void detectRectangles(const cv::Mat &thresImg,vector<MarkerCandidate> & candidates);
+    //sizeRef is the size employed for the relative min and max contour sizes, max(cols,rows) of the whole image
+    void detectRectangles(const cv::Mat &thresImg,vector<MarkerCandidate> & candidates,Workspace &ws,int sizeRef)const;
+    //detection steps up to the corner refinement, the marker sizes are relative to sizeRef
+    void detectMarkers(const cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws,int sizeRef)const throw (cv::Exception);
+    //same as detectMarkers for the whole image, in parallel tiles if tiling is enabled
+    void detectMarkersTiled(const cv::Mat &input,std::vector<Marker> &detectedMarkers,Workspace &ws)const throw (cv::Exception);
+    //extrinsics of the markers, with the undistortion table of camParams if not NULL (for solvePnP too)
+    void calculateExtrinsics(std::vector<Marker> &markers,float markerSizeMeters,const cv::Mat &camMatrix,const cv::Mat &distCoeff,
+                             const CameraParameters *camParams,bool setYPerperdicular)const throw (cv::Exception);
+    //removes the markers with repeated id, keeping the one with largest perimeter. Markers must be sorted by id
+    void removeDuplicates(std::vector<Marker> &markers,Stats &stats)const;
+    //thresHold with the scratch memory of the fast kernels
+    void thresHold(int method,const cv::Mat &grey,cv::Mat &thresImg,double param1,double param2,std::vector<int> &buffer)const throw(cv::Exception);
     //Current threshold method
     ThresholdMethods _thresMethod;
     //Threshold parameters
@@ -289,21 +506,27 @@ private:
     int _speed;
     int _markerWarpSize;
     bool _doErosion;
-    //vectr of candidates to be markers. This is a vector with a set of rectangles that have no valid id
-    vector<std::vector<cv::Point2f> > _candidates;
+    bool _fastThreshold;
+    bool _planarPose;
+    bool _homographySampling;
+    bool _fastLineFit;
+    bool _parallelMarkers;
+    //tiles of the image and their overlap, see setTiling
+    int _tilesX,_tilesY;
+    float _tileOverlap;
     //level of image reduction
     int pyrdown_level;
-    //Images
-    cv::Mat grey,thres,thres2,reduced;
+    //scratch data of the non reentrant detect methods
+    Workspace _ws;
     //pointer to the function that analizes a rectangular region so as to detect its internal marker
     int (* markerIdDetector_ptrfunc)(const cv::Mat &in,int &nRotations);
 
     /**
      */
-    bool isInto(cv::Mat &contour,std::vector<cv::Point2f> &b);
+    bool isInto(cv::Mat &contour,std::vector<cv::Point2f> &b)const;
     /**
      */
-    int perimeter(std::vector<cv::Point2f> &a);
+    int perimeter(std::vector<cv::Point2f> &a)const;
 
     
 //     //GL routines
@@ -316,12 +539,12 @@ private:
 // 
 
     //detection of the
-    void findBestCornerInRegion_harris(const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize);
+    void findBestCornerInRegion_harris(const cv::Mat  & grey,vector<cv::Point2f> &  Corners,int blockSize)const;
    
     
     // auxiliar functions to perform LINES refinement
-    void interpolate2Dline( const vector< cv::Point > &inPoints, cv::Point3f &outLine);
-    cv::Point2f getCrossPoint(const cv::Point3f& line1, const cv::Point3f& line2);      
+    void interpolate2Dline( const vector< cv::Point > &inPoints, cv::Point3f &outLine)const;
+    cv::Point2f getCrossPoint(const cv::Point3f& line1, const cv::Point3f& line2)const;      
     
     
     /**Given a vector vinout with elements and a boolean vector indicating the lements from it to remove, 
@@ -330,7 +553,7 @@ private:
      * @param toRemove
      */
     template<typename T>
-    void removeElements(vector<T> & vinout,const vector<bool> &toRemove)
+    void removeElements(vector<T> & vinout,const vector<bool> &toRemove)const
     {
        //remove the invalid ones by setting the valid in the positions left by the invalids
       size_t indexValid=0;
@@ -0,0 +1,332 @@
+#include "planarpose.h"
+#include <cmath>
+#include <limits>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace aruco
+{
+
+namespace
+{
+//solves the n x n system A x = b (row major) by gaussian elimination with partial pivoting, b is overwritten with x
+bool solveLinear(double *A,double *b,int n)
+{
+    for (int c=0;c<n;c++)
+    {
+        int p=c;
+        for (int r=c+1;r<n;r++)
+            if (std::fabs(A[r*n+c])>std::fabs(A[p*n+c])) p=r;
+        if (std::fabs(A[p*n+c])<1e-12) return false;
+        if (p!=c)
+        {
+            for (int k=0;k<n;k++) std::swap(A[c*n+k],A[p*n+k]);
+            std::swap(b[c],b[p]);
+        }
+        for (int r=c+1;r<n;r++)
+        {
+            double f=A[r*n+c]/A[c*n+c];
+            for (int k=c;k<n;k++) A[r*n+k]-=f*A[c*n+k];
+            b[r]-=f*b[c];
+        }
+    }
+    for (int c=n-1;c>=0;c--)
+    {
+        for (int k=c+1;k<n;k++) b[c]-=A[c*n+k]*b[k];
+        b[c]/=A[c*n+c];
+    }
+    return true;
+}
+
+//C=A*B for 3x3 row major matrices
+void mul33(const double A[9],const double B[9],double C[9])
+{
+    for (int r=0;r<3;r++)
+        for (int c=0;c<3;c++)
+            C[r*3+c]=A[r*3]*B[c]+A[r*3+1]*B[3+c]+A[r*3+2]*B[6+c];
+}
+
+//rotation matrix of the rotation vector w
+void expRotation(const double w[3],double R[9])
+{
+    double theta=std::sqrt(w[0]*w[0]+w[1]*w[1]+w[2]*w[2]);
+    double a,b;
+    if (theta<1e-10) { a=1; b=0.5; }
+    else { a=std::sin(theta)/theta; b=(1-std::cos(theta))/(theta*theta); }
+    //R=I+a*[w]x+b*[w]x^2
+    double wx=w[0],wy=w[1],wz=w[2];
+    R[0]=1-b*(wy*wy+wz*wz); R[1]=-a*wz+b*wx*wy;    R[2]=a*wy+b*wx*wz;
+    R[3]=a*wz+b*wx*wy;     R[4]=1-b*(wx*wx+wz*wz); R[5]=-a*wx+b*wy*wz;
+    R[6]=-a*wy+b*wx*wz;    R[7]=a*wx+b*wy*wz;     R[8]=1-b*(wx*wx+wy*wy);
+}
+
+//homography H (row major, H[8]=1) from the model square to the image points. The unit square is mapped in
+//closed form (P. Heckbert, "Fundamentals of texture mapping and image warping", 1989), then composed with
+//the model to unit square transform
+bool squareHomography(const double u[8],double halfSize,double H[9])
+{
+    //unit square corners (0,0),(1,0),(1,1),(0,1) are the model corners 0,3,2,1
+    double x0=u[0],y0=u[1],x1=u[6],y1=u[7],x2=u[4],y2=u[5],x3=u[2],y3=u[3];
+    double dx1=x1-x2,dx2=x3-x2,dx3=x0-x1+x2-x3;
+    double dy1=y1-y2,dy2=y3-y2,dy3=y0-y1+y2-y3;
+    double den=dx1*dy2-dx2*dy1;
+    if (std::fabs(den)<1e-15) return false;
+    double g=(dx3*dy2-dx2*dy3)/den;
+    double h=(dx1*dy3-dx3*dy1)/den;
+    double Hu[9]={x1-x0+g*x1,x3-x0+h*x3,x0,
+                  y1-y0+g*y1,y3-y0+h*y3,y0,
+                  g,h,1};
+    double s=0.5/halfSize;
+    double S[9]={s,0,0.5,
+                 0,s,0.5,
+                 0,0,1};
+    mul33(Hu,S,H);
+    if (std::fabs(H[8])<1e-15) return false;
+    for (int i=0;i<9;i++) H[i]/=H[8];
+    return true;
+}
+
+//the two rotations of IPPE, given the jacobian J of the homography at the model origin and the image p,q of the origin
+bool ippeRotations(double j00,double j01,double j10,double j11,double p,double q,double R1[9],double R2[9])
+{
+    //rotation Rv taking the z axis to the viewing ray of the origin
+    double nrm=std::sqrt(p*p+q*q+1);
+    double ax=p/nrm,ay=q/nrm,az=1/nrm;
+    double d=1/(1+az);
+    double Rv[9]={1-ax*ax*d,-ax*ay*d,ax,
+                  -ax*ay*d,1-ay*ay*d,ay,
+                  -ax,-ay,1-(ax*ax+ay*ay)*d};
+
+    double b00=Rv[0]-p*Rv[6],b01=Rv[1]-p*Rv[7];
+    double b10=Rv[3]-q*Rv[6],b11=Rv[4]-q*Rv[7];
+    double det=b00*b11-b01*b10;
+    if (std::fabs(det)<1e-15) return false;
+    double binv00=b11/det,binv01=-b01/det,binv10=-b10/det,binv11=b00/det;
+
+    double a00=binv00*j00+binv01*j10,a01=binv00*j01+binv01*j11;
+    double a10=binv10*j00+binv11*j10,a11=binv10*j01+binv11*j11;
+
+    //largest singular value of A
+    double ata00=a00*a00+a01*a01,ata01=a00*a10+a01*a11,ata11=a10*a10+a11*a11;
+    double gamma2=0.5*(ata00+ata11+std::sqrt((ata00-ata11)*(ata00-ata11)+4*ata01*ata01));
+    if (!(gamma2>0)) return false;
+    double gamma=std::sqrt(gamma2);
+
+    double r00=a00/gamma,r01=a01/gamma,r10=a10/gamma,r11=a11/gamma;
+    double b0=std::sqrt(std::max(0.,1-r00*r00-r10*r10));
+    double b1=std::sqrt(std::max(0.,1-r01*r01-r11*r11));
+    if (-r00*r01-r10*r11<0) b1=-b1;
+
+    //the two solutions differ in the sign of the out of plane components
+    for (int s=0;s<2;s++)
+    {
+        double *R=s==0?R1:R2;
+        double sb0=s==0?b0:-b0,sb1=s==0?b1:-b1;
+        double c0=sb1*r10-sb0*r11,c1=sb0*r01-sb1*r00,c2=r00*r11-r01*r10;
+        double Rt[9]={r00,r01,c0,
+                      r10,r11,c1,
+                      sb0,sb1,c2};
+        mul33(Rv,Rt,R);
+    }
+    return true;
+}
+
+//translation minimizing the algebraic error of the points (X[i],Y[i],0) seen at u, for the rotation R
+bool planeTranslation(const double R[9],const double X[4],const double Y[4],const double u[8],double t[3])
+{
+    double A[9]={0,0,0,0,0,0,0,0,0};
+    double b[3]={0,0,0};
+    for (int i=0;i<4;i++)
+    {
+        double ux=u[2*i],uy=u[2*i+1];
+        double rx=R[0]*X[i]+R[1]*Y[i],ry=R[3]*X[i]+R[4]*Y[i],rz=R[6]*X[i]+R[7]*Y[i];
+        //tx-ux*tz=ux*rz-rx and ty-uy*tz=uy*rz-ry
+        double ex=ux*rz-rx,ey=uy*rz-ry;
+        A[0]+=1; A[2]-=ux;
+        A[4]+=1; A[5]-=uy;
+        A[8]+=ux*ux+uy*uy;
+        b[0]+=ex; b[1]+=ey; b[2]-=ux*ex+uy*ey;
+    }
+    A[6]=A[2]; A[7]=A[5];
+    if (!solveLinear(A,b,3)) return false;
+    t[0]=b[0]; t[1]=b[1]; t[2]=b[2];
+    return true;
+}
+
+//sum of the squared reprojection errors, infinite if a point is behind the camera
+double reprojectionError(const double R[9],const double t[3],const double X[4],const double Y[4],const double u[8])
+{
+    double err=0;
+    for (int i=0;i<4;i++)
+    {
+        double x=R[0]*X[i]+R[1]*Y[i]+t[0];
+        double y=R[3]*X[i]+R[4]*Y[i]+t[1];
+        double z=R[6]*X[i]+R[7]*Y[i]+t[2];
+        if (z<=0) return std::numeric_limits<double>::max();
+        double ex=x/z-u[2*i],ey=y/z-u[2*i+1];
+        err+=ex*ex+ey*ey;
+    }
+    return err;
+}
+
+//Gauss-Newton iterations on the reprojection error, the rotation is updated as exp(w)*R
+void refinePose(double R[9],double t[3],const double X[4],const double Y[4],const double u[8],int iterations)
+{
+    for (int it=0;it<iterations;it++)
+    {
+        double H[36],g[6];
+        for (int i=0;i<36;i++) H[i]=0;
+        for (int i=0;i<6;i++) g[i]=0;
+        for (int i=0;i<4;i++)
+        {
+            //point rotated and in the camera
+            double px=R[0]*X[i]+R[1]*Y[i],py=R[3]*X[i]+R[4]*Y[i],pz=R[6]*X[i]+R[7]*Y[i];
+            double x=px+t[0],y=py+t[1],z=pz+t[2];
+            if (z<=0) return;
+            double iz=1/z;
+            double ex=x*iz-u[2*i],ey=y*iz-u[2*i+1];
+            //d(x/z,y/z)/d(x,y,z), times d(x,y,z)/d(w,t)=[-[p]x | I]
+            double dx[3]={iz,0,-x*iz*iz},dy[3]={0,iz,-y*iz*iz};
+            double Jx[6]={dx[2]*py-dx[1]*pz,dx[0]*pz-dx[2]*px,dx[1]*px-dx[0]*py,dx[0],dx[1],dx[2]};
+            double Jy[6]={dy[2]*py-dy[1]*pz,dy[0]*pz-dy[2]*px,dy[1]*px-dy[0]*py,dy[0],dy[1],dy[2]};
+            for (int r=0;r<6;r++)
+            {
+                for (int c=0;c<6;c++) H[r*6+c]+=Jx[r]*Jx[c]+Jy[r]*Jy[c];
+                g[r]-=Jx[r]*ex+Jy[r]*ey;
+            }
+        }
+        if (!solveLinear(H,g,6)) return;
+        double dR[9],Rn[9];
+        expRotation(g,dR);
+        mul33(dR,R,Rn);
+        for (int i=0;i<9;i++) R[i]=Rn[i];
+        for (int i=0;i<3;i++) t[i]+=g[3+i];
+    }
+}
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+bool PlanarSquarePose::solveSquare(const double imgPoints[8],double markerSize,int refineIterations,double R[9],double t[3])
+{
+    double h=markerSize/2.;
+    const double X[4]={-h,-h,h,h};
+    const double Y[4]={-h,h,h,-h};
+
+    double H[9];
+    if (!squareHomography(imgPoints,h,H)) return false;
+    //jacobian of the homography and image of the model origin
+    double p=H[2],q=H[5];
+    double R1[9],R2[9];
+    if (!ippeRotations(H[0]-H[6]*p,H[1]-H[7]*p,H[3]-H[6]*q,H[4]-H[7]*q,p,q,R1,R2)) return false;
+
+    double t1[3],t2[3];
+    double err1=planeTranslation(R1,X,Y,imgPoints,t1)?reprojectionError(R1,t1,X,Y,imgPoints):std::numeric_limits<double>::max();
+    double err2=planeTranslation(R2,X,Y,imgPoints,t2)?reprojectionError(R2,t2,X,Y,imgPoints):std::numeric_limits<double>::max();
+    if (std::min(err1,err2)==std::numeric_limits<double>::max()) return false;
+    const double *Rb=err1<=err2?R1:R2,*tb=err1<=err2?t1:t2;
+    for (int i=0;i<9;i++) R[i]=Rb[i];
+    for (int i=0;i<3;i++) t[i]=tb[i];
+
+    refinePose(R,t,X,Y,imgPoints,refineIterations);
+    return t[2]>0;
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void PlanarSquarePose::calculateExtrinsics(std::vector<Marker> &markers,float markerSize,const cv::Mat &camMatrix,const cv::Mat &distCoeff,
+                                           bool setYPerperdicular,int refineIterations) throw (cv::Exception)
+{
+    if (markers.empty()) return;
+    if (camMatrix.rows==0 || camMatrix.cols==0) throw cv::Exception(9004,"CameraMatrix is empty","PlanarSquarePose::calculateExtrinsics",__FILE__,__LINE__);
+    //corners of all the markers in normalized image coordinates
+    std::vector<cv::Point2f> corners,normalized;
+    getCorners(markers,markerSize,corners);
+    cv::undistortPoints(corners,normalized,camMatrix,distCoeff);
+    setExtrinsics(markers,markerSize,normalized,camMatrix,distCoeff,setYPerperdicular,refineIterations);
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void PlanarSquarePose::calculateExtrinsics(std::vector<Marker> &markers,float markerSize,const CameraParameters &camParams,
+                                           bool setYPerperdicular,int refineIterations) throw (cv::Exception)
+{
+    if (markers.empty()) return;
+    if (camParams.CameraMatrix.rows==0 || camParams.CameraMatrix.cols==0) throw cv::Exception(9004,"CameraMatrix is empty","PlanarSquarePose::calculateExtrinsics",__FILE__,__LINE__);
+    std::vector<cv::Point2f> corners,normalized;
+    getCorners(markers,markerSize,corners);
+    camParams.undistortPoints(corners,normalized);
+    setExtrinsics(markers,markerSize,normalized,camParams.CameraMatrix,camParams.Distorsion,setYPerperdicular,refineIterations);
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void PlanarSquarePose::getCorners(const std::vector<Marker> &markers,float markerSize,std::vector<cv::Point2f> &corners) throw (cv::Exception)
+{
+    if (markerSize<=0) throw cv::Exception(9004,"markerSize<=0: invalid markerSize","PlanarSquarePose::calculateExtrinsics",__FILE__,__LINE__);
+    corners.clear();
+    corners.reserve(markers.size()*4);
+    for (size_t i=0;i<markers.size();i++)
+    {
+        if (!markers[i].isValid()) throw cv::Exception(9004,"!isValid(): invalid marker. It is not possible to calculate extrinsics","PlanarSquarePose::calculateExtrinsics",__FILE__,__LINE__);
+        for (int c=0;c<4;c++) corners.push_back(markers[i][c]);
+    }
+}
+
+/************************************
+ *
+ *
+ *
+ *
+ ************************************/
+void PlanarSquarePose::setExtrinsics(std::vector<Marker> &markers,float markerSize,const std::vector<cv::Point2f> &normalized,
+                                     const cv::Mat &camMatrix,const cv::Mat &distCoeff,bool setYPerperdicular,int refineIterations)
+{
+    for (size_t i=0;i<markers.size();i++)
+    {
+        double u[8],R[9],t[3];
+        for (int c=0;c<4;c++)
+        {
+            u[2*c]=normalized[i*4+c].x;
+            u[2*c+1]=normalized[i*4+c].y;
+        }
+        if (!solveSquare(u,markerSize,refineIterations,R,t))
+        {
+            markers[i].calculateExtrinsics(markerSize,camMatrix,distCoeff,setYPerperdicular);
+            continue;
+        }
+        //rotate the X axis 90 degrees so that Y is perpendicular to the marker plane: the columns become (r0,r2,-r1)
+        if (setYPerperdicular)
+        {
+            for (int r=0;r<3;r++)
+            {
+                double r1=R[r*3+1];
+                R[r*3+1]=R[r*3+2];
+                R[r*3+2]=-r1;
+            }
+        }
+        cv::Mat Rmat(3,3,CV_64FC1,R),rvec;
+        cv::Rodrigues(Rmat,rvec);
+        rvec.convertTo(markers[i].Rvec,CV_32F);
+        cv::Mat(3,1,CV_64FC1,t).convertTo(markers[i].Tvec,CV_32F);
+        markers[i].ssize=markerSize;
+    }
+}
+
+}
@@ -0,0 +1,61 @@
+#ifndef _ARUCO_PlanarPose_H
+#define _ARUCO_PlanarPose_H
+#include <vector>
+#include <opencv2/core/core.hpp>
+#include "exports.h"
+#include "marker.h"
+#include "cameraparameters.h"
+
+namespace aruco
+{
+
+/**\brief Pose of square markers from their four corners
+ *
+ * The pose is computed in closed form with the IPPE method (T. Collins and A. Bartoli, "Infinitesimal Plane-based
+ * Pose Estimation", IJCV 2014), which gives the two poses compatible with the homography of the square. The one
+ * with the smallest reprojection error is then refined with a few Gauss-Newton iterations. This is much cheaper than
+ * the generic iterative cv::solvePnP employed by Marker::calculateExtrinsics, and gives the same pose.
+ */
+class ARUCO_EXPORTS PlanarSquarePose
+{
+public:
+    /**Calculates the extrinsics of all the markers passed, as Marker::calculateExtrinsics does for each one.
+     * The corners of all the markers are undistorted together. Markers whose pose can not be solved this way
+     * fall back to Marker::calculateExtrinsics
+     * @param markers markers to process
+     * @param markerSize size of the marker sides
+     * @param camMatrix matrix with camera parameters (fx,fy,cx,cy)
+     * @param distCoeff matrix with distorsion parameters (k1,k2,p1,p2), empty if no distortion
+     * @param setYPerperdicular If set the Y axis will be perpendicular to the surface. Otherwise, it will be the Z axis
+     * @param refineIterations number of Gauss-Newton iterations after the closed form solution
+     */
+    static void calculateExtrinsics(std::vector<Marker> &markers,float markerSize,const cv::Mat &camMatrix,const cv::Mat &distCoeff,
+                                    bool setYPerperdicular=true,int refineIterations=2) throw (cv::Exception);
+
+    /**Same as above, but the corners are undistorted with CameraParameters::undistortPoints, a lookup in a precomputed
+     * table instead of the iterative undistortion of cv::undistortPoints
+     */
+    static void calculateExtrinsics(std::vector<Marker> &markers,float markerSize,const CameraParameters &camParams,
+                                    bool setYPerperdicular=true,int refineIterations=2) throw (cv::Exception);
+
+    /**Pose of a square of side markerSize in the plane z=0, centered in the origin, with corners
+     * (-s/2,-s/2), (-s/2,s/2), (s/2,s/2), (s/2,-s/2) in this order, as in Marker::calculateExtrinsics.
+     * @param imgPoints corners in normalized image coordinates (x0,y0,x1,y1,...)
+     * @param markerSize size of the square side
+     * @param refineIterations number of Gauss-Newton iterations
+     * @param R output rotation matrix, row major
+     * @param t output translation
+     * @return false if the corners do not give a valid pose
+     */
+    static bool solveSquare(const double imgPoints[8],double markerSize,int refineIterations,double R[9],double t[3]);
+
+private:
+    //corners of the markers, checking them
+    static void getCorners(const std::vector<Marker> &markers,float markerSize,std::vector<cv::Point2f> &corners) throw (cv::Exception);
+    //sets the extrinsics from the normalized corners given by getCorners
+    static void setExtrinsics(std::vector<Marker> &markers,float markerSize,const std::vector<cv::Point2f> &normalized,
+                              const cv::Mat &camMatrix,const cv::Mat &distCoeff,bool setYPerperdicular,int refineIterations);
+};
+
+}
+#endif
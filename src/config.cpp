@@ -10,11 +10,29 @@ std::string Config::STR_FOlDERPATH_IMG;
 std::string Config::STR_FILEPATH_ODO;
 std::string Config::STR_FILEPATH_CAM;
 std::string Config::STR_FILEPATH_CALIB;
+std::string Config::STR_FILEPATH_CACHE;
+std::string Config::STR_FILEPATH_DETECT_STATS;
 
 //! Dataset
 double Config::DATASET_THRESH_KF_ODOLIN;
 double Config::DATASET_THRESH_KF_ODOROT;
 double Config::MARK_SIZE;
+int Config::DATASET_LOAD_MODE;
+int Config::DATASET_NUM_THREAD_LOAD;
+int Config::DATASET_NUM_BUFFER_LOAD;
+bool Config::DATASET_IMG_GREY;
+bool Config::DATASET_USE_CACHE;
+int Config::DATASET_NUM_THREAD_DETECT;
+int Config::DATASET_PYR_DOWN_LEVEL;
+double Config::DATASET_PYR_MIN_MARK;
+int Config::DATASET_PYR_NUM_PROBE;
+bool Config::DATASET_TRACK_DETECT;
+int Config::DATASET_TRACK_NUM_FULL;
+double Config::DATASET_TRACK_ROI_MARGIN;
+std::vector<double> Config::DATASET_TRACK_SE3BC;
+bool Config::DATASET_WRITE_DETECT_STATS;
+int Config::DATASET_DETECT_TILE;
+double Config::DATASET_DETECT_TILE_OVERLAP;
 
 //! Solver
 double Config::CALIB_ODOLIN_ERRR;
@@ -35,11 +53,29 @@ void Config::InitConfig(std::string _strfolderpathmain,
     STR_FOlDERPATH_IMG = _strfolderpathmain+"image/";
     STR_FILEPATH_ODO = _strfolderpathmain+"/rec/Odo.rec";
     STR_FILEPATH_CAM = _strfolderpathmain+"config/CamConfig.yml";
+    STR_FILEPATH_CACHE = _strfolderpathmain+"Detect.cache";
+    STR_FILEPATH_DETECT_STATS = _strfolderpathmain+"DetectStats"; // .csv and .json are appended
     NUM_FRAME = numframe;
     MARK_SIZE = marksize;
 
     DATASET_THRESH_KF_ODOLIN = 100;
     DATASET_THRESH_KF_ODOROT = 5*PI/180;
+    DATASET_LOAD_MODE = 0; // 0: load all frames, 1: streaming, 2: odometry first
+    DATASET_NUM_THREAD_LOAD = 4; // 0: use all cores
+    DATASET_NUM_BUFFER_LOAD = 16;
+    DATASET_IMG_GREY = false; // decode and keep single channel images only, grey levels may differ from BGR2GRAY
+    DATASET_USE_CACHE = false; // reuse detections of STR_FILEPATH_CACHE, images are checked by size and mtime only
+    DATASET_NUM_THREAD_DETECT = 0; // 0: use all cores
+    DATASET_PYR_DOWN_LEVEL = 0; // -1: select from the marks seen in a few keyframes
+    DATASET_PYR_MIN_MARK = 40; // smallest mark side in pixels to keep in the reduced image
+    DATASET_PYR_NUM_PROBE = 5; // keyframes detected at full resolution to select the level
+    DATASET_TRACK_DETECT = false; // search marks around their location predicted by odometry
+    DATASET_TRACK_NUM_FULL = 10; // keyframes between two full image detections when tracking
+    DATASET_TRACK_ROI_MARGIN = 0.5; // margin of the search regions, ratio to the predicted mark radius
+    DATASET_TRACK_SE3BC = {0, 0, 0, 0, 0, 0}; // extrinsic guess for tracking: rvec, tvec of camera in base, tracking is disabled while all zero
+    DATASET_WRITE_DETECT_STATS = false; // print the detector statistics of the run and write them to STR_FILEPATH_DETECT_STATS
+    DATASET_DETECT_TILE = 1; // tiles per image side detected in parallel, 1: no tiling
+    DATASET_DETECT_TILE_OVERLAP = 0.1; // overlap of the tiles, ratio to the image size, raised by the detector to fit the biggest mark
 
     CALIB_ODOLIN_ERRR = 0.01;
     CALIB_ODOLIN_ERRMIN = 1;
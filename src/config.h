@@ -2,6 +2,7 @@
 #define CONFIG_H
 
 #include <string>
+#include <vector>
 
 namespace calibcamodo {
 
@@ -17,11 +18,29 @@ public:
     static std::string STR_FILEPATH_ODO;
     static std::string STR_FILEPATH_CAM;
     static std::string STR_FILEPATH_CALIB;
+    static std::string STR_FILEPATH_CACHE;
+    static std::string STR_FILEPATH_DETECT_STATS;
 
     //! Dataset
     static double DATASET_THRESH_KF_ODOLIN;
     static double DATASET_THRESH_KF_ODOROT;
     static double MARK_SIZE;
+    static int DATASET_LOAD_MODE;
+    static int DATASET_NUM_THREAD_LOAD;
+    static int DATASET_NUM_BUFFER_LOAD;
+    static bool DATASET_IMG_GREY;
+    static bool DATASET_USE_CACHE;
+    static int DATASET_NUM_THREAD_DETECT;
+    static int DATASET_PYR_DOWN_LEVEL;
+    static double DATASET_PYR_MIN_MARK;
+    static int DATASET_PYR_NUM_PROBE;
+    static bool DATASET_TRACK_DETECT;
+    static int DATASET_TRACK_NUM_FULL;
+    static double DATASET_TRACK_ROI_MARGIN;
+    static std::vector<double> DATASET_TRACK_SE3BC;
+    static bool DATASET_WRITE_DETECT_STATS;
+    static int DATASET_DETECT_TILE;
+    static double DATASET_DETECT_TILE_OVERLAP;
 
     //! Solver
     static double CALIB_ODOLIN_ERRR;
@@ -3,6 +3,17 @@
 #include "measure.h"
 #include "mark.h"
 #include "config.h"
+#include "imgloader.h"
+#include "detectcache.h"
+#include "detectstats.h"
+
+#include <atomic>
+#include <exception>
+#include <limits>
+#include <thread>
+
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
 
 namespace calibcamodo {
 
@@ -18,190 +29,607 @@ Dataset::Dataset() {
     mstrFoldPathImg = Config::STR_FOlDERPATH_IMG;
     mstrFilePathCam = Config::STR_FILEPATH_CAM;
     mstrFilePathOdo = Config::STR_FILEPATH_ODO;
+    mstrFilePathCache = Config::STR_FILEPATH_CACHE;
+    mbUseCache = Config::DATASET_USE_CACHE;
 
  // load camera intrinsics
     mCamParam.readFromXMLFile(mstrFilePathCam);
 
     // set aruco mark detector
-    int ThePyrDownLevel = 0;
-    int ThresParam1 = 19;
-    int ThresParam2 = 15;
-    mMDetector.pyrDown(ThePyrDownLevel);
-    mMDetector.setCornerRefinementMethod(MarkerDetector::LINES);
-    mMDetector.setThresholdParams(ThresParam1, ThresParam2);
+    mPyrDownLevel = Config::DATASET_PYR_DOWN_LEVEL;
+    mPyrMinMark = Config::DATASET_PYR_MIN_MARK;
+    mNumPyrProbe = Config::DATASET_PYR_NUM_PROBE;
+    mNumDetectTile = Config::DATASET_DETECT_TILE;
+    mDetectTileOverlap = Config::DATASET_DETECT_TILE_OVERLAP;
+    ConfigDetector(mMDetector);
+    mNumThreadDetect = Config::DATASET_NUM_THREAD_DETECT;
+    mbWriteDetectStats = Config::DATASET_WRITE_DETECT_STATS;
+    mstrFilePathDetectStats = Config::STR_FILEPATH_DETECT_STATS;
+
+    // tracking detection
+    mbTrackDetect = Config::DATASET_TRACK_DETECT;
+    mNumTrackFull = Config::DATASET_TRACK_NUM_FULL;
+    mTrackRoiMargin = Config::DATASET_TRACK_ROI_MARGIN;
+    const vector<double> &se3bc = Config::DATASET_TRACK_SE3BC;
+    Mat rvecbc = (Mat_<float>(3,1) << se3bc[0], se3bc[1], se3bc[2]);
+    Mat tvecbc = (Mat_<float>(3,1) << se3bc[3], se3bc[4], se3bc[5]);
+    mSe3bcTrack = Se3(rvecbc, tvecbc);
+    // the default guess puts the camera at the base origin, predicted regions
+    // would be wrong on a real rig
+    if (mbTrackDetect && countNonZero(rvecbc) == 0 && countNonZero(tvecbc) == 0) {
+        cerr << "Error in Dataset::Dataset, DATASET_TRACK_SE3BC is not set, tracking detection is disabled" << endl;
+        mbTrackDetect = false;
+    }
 
     // select keyframe
     mThreshOdoLin = Config::DATASET_THRESH_KF_ODOLIN;
     mThreshOdoRot = Config::DATASET_THRESH_KF_ODOROT;
+
+    // image decode pool
+    mNumThreadLoad = Config::DATASET_NUM_THREAD_LOAD;
+    mNumBufferLoad = Config::DATASET_NUM_BUFFER_LOAD;
+    mFlagRead = Config::DATASET_IMG_GREY ? CV_LOAD_IMAGE_GRAYSCALE : CV_LOAD_IMAGE_COLOR;
 }
 
 Dataset::~Dataset(){}
 
-void Dataset::CreateFrame() {
+void Dataset::SetTrackExtrinsic(const Se3 &_se3bc) {
+    mSe3bcTrack = _se3bc;
+    mbTrackDetect = Config::DATASET_TRACK_DETECT;
+}
+
+void Dataset::ConfigDetector(MarkerDetector &_detector) const {
+    int ThePyrDownLevel = max(0, mPyrDownLevel);
+    int ThresParam1 = 19;
+    int ThresParam2 = 15;
+    _detector.pyrDown(ThePyrDownLevel);
+    _detector.setCornerRefinementMethod(MarkerDetector::LINES);
+    _detector.setThresholdParams(ThresParam1, ThresParam2);
+    _detector.setTiling(max(1, mNumDetectTile), max(1, mNumDetectTile), mDetectTileOverlap);
+}
+
+bool Dataset::CreateFrame() {
 
     // load image
     map<int, Mat> mapId2Img;
+    vector<string> vecImgPath;
+    for (int i = 0; i < mNumFrame; ++i)
+        vecImgPath.push_back(GetImgPath(i));
+    ImgLoader loader(vecImgPath, mNumThreadLoad, mNumBufferLoad, mFlagRead);
     for (int i = 0; i < mNumFrame; ++i) {
-        string strImgPath = mstrFoldPathImg + to_string(i) + ".bmp";
-        Mat img = imread(strImgPath);
+        Mat img;
+        loader.Next(img);
         if (!img.empty())
             mapId2Img[i] = img;
     }
 
     // load odometry
-    map<int, Se2> mapId2Odo;
-    ifstream logFile_stream(mstrFilePathOdo);
-    string str_tmp;
-    while(getline(logFile_stream, str_tmp)) {
-        // read time info
-        Se2 odo_tmp;
-        int id_tmp;
-        if (ParseOdoData(str_tmp, odo_tmp, id_tmp)) {
-            mapId2Odo[id_tmp] = odo_tmp;
-        }
-    }
+    if (!LoadOdoData())
+        return false;
+    const vector<OdoRecord> &vecOdo = mvecOdo;
 
-    // build frame vector
-    int maxIdImg = mapId2Img.crbegin()->first;
-    int maxIdOdo = mapId2Odo.crbegin()->first;
-    int maxId = maxIdImg > maxIdOdo ? maxIdImg : maxIdOdo;
-    for (int i = 0; i <= maxId; ++i) {
-        const auto iterImg = mapId2Img.find(i);
-        const auto iterOdo = mapId2Odo.find(i);
-        if (iterImg != mapId2Img.cend() && iterOdo != mapId2Odo.cend()) {
-            PtrFrame pf = make_shared<Frame>(iterImg->second, iterOdo->second, i);
+    // build frame vector, odometry records are sorted by id
+    for (const auto &rec : vecOdo) {
+        const auto iterImg = mapId2Img.find(rec.id);
+        if (iterImg != mapId2Img.cend()) {
+            PtrFrame pf = make_shared<Frame>(iterImg->second, rec.odo, rec.id);
             InsertFrame(pf);
         }
     }
 
-    return;
+    return true;
 }
 
-bool Dataset::ParseOdoData(const string _str, Se2 &_odo, int &_id) {
-    vector<string> vec_str = SplitString(_str, " ");
+bool Dataset::CreateKeyFrameStream() {
 
-    // fail
-    if (vec_str[0] == "#") return false;
+    // odometry is small, load it first to know which ids have a frame
+    if (!LoadOdoData())
+        return false;
+    const vector<OdoRecord> &vecOdo = mvecOdo;
+
+    // read images in id order and only keep the ones selected as keyframe,
+    // so that memory depends on the number of keyframes instead of frames
+    vector<int> vecIdxOdo;
+    vector<string> vecImgPath;
+    for (int i = 0; i < (int)vecOdo.size(); ++i) {
+        int id = vecOdo[i].id;
+        if (id < 0 || id >= mNumFrame)
+            continue;
+        vecIdxOdo.push_back(i);
+        vecImgPath.push_back(GetImgPath(id));
+    }
 
-    // read data
-    _id = atof(vec_str[0].c_str());
-    _odo.x = atof(vec_str[3].c_str());
-    _odo.y = atof(vec_str[4].c_str());
-    _odo.theta = atof(vec_str[5].c_str());
+    PtrKeyFrame pKeyFrameLast = nullptr;
+    ImgLoader loader(vecImgPath, mNumThreadLoad, mNumBufferLoad, mFlagRead);
+    for (int idx : vecIdxOdo) {
+        Mat img;
+        loader.Next(img);
+        if (img.empty())
+            continue;
+        Frame frame(img, vecOdo[idx].odo, vecOdo[idx].id);
+        SelectKeyFrame(frame, pKeyFrameLast);
+    }
+    DetectKeyFrame();
     return true;
 }
 
-vector<string> Dataset::SplitString(const string _str, const string _separator) {
-    string str = _str;
-    vector<string> vecstr_return;
-    int cut_at;
-    while ((cut_at = str.find_first_of(_separator)) != str.npos) {
-        if (cut_at > 0) {
-            vecstr_return.push_back(str.substr(0, cut_at));
+bool Dataset::CreateKeyFrameOdoFirst() {
+
+    if (!LoadOdoData())
+        return false;
+    const vector<OdoRecord> &vecOdo = mvecOdo;
+
+    PtrKeyFrame pKeyFrameLast = nullptr;
+    int idxStart = 0;
+    while (idxStart < (int)vecOdo.size()) {
+
+        // keyframe selection only needs odometry, images are checked to exist
+        // here but not decoded
+        vector<int> vecIdxKf;
+        bool bKfLast = pKeyFrameLast != nullptr;
+        Se2 odoKfLast = bKfLast ? pKeyFrameLast->GetOdo() : Se2();
+        for (int i = idxStart; i < (int)vecOdo.size(); ++i) {
+            int id = vecOdo[i].id;
+            if (id < 0 || id >= mNumFrame)
+                continue;
+            if (bKfLast && !IsKeyFrame(vecOdo[i].odo, odoKfLast))
+                continue;
+            if (!ifstream(GetImgPath(id)).good())
+                continue;
+            vecIdxKf.push_back(i);
+            bKfLast = true;
+            odoKfLast = vecOdo[i].odo;
+        }
+
+        // decode images of the selected keyframes only
+        vector<string> vecImgPath;
+        for (int idx : vecIdxKf)
+            vecImgPath.push_back(GetImgPath(vecOdo[idx].id));
+
+        // an image that fails to decode is skipped as in LOAD_STREAM, the
+        // selection is then done again from the next record
+        idxStart = vecOdo.size();
+        ImgLoader loader(vecImgPath, mNumThreadLoad, mNumBufferLoad, mFlagRead);
+        for (int idx : vecIdxKf) {
+            Mat img;
+            loader.Next(img);
+            if (img.empty()) {
+                cerr << "Error in Dataset::CreateKeyFrameOdoFirst, fail to decode image " << vecOdo[idx].id << endl;
+                idxStart = idx + 1;
+                break;
+            }
+            Frame frame(img, vecOdo[idx].odo, vecOdo[idx].id);
+            AddKeyFrame(frame, pKeyFrameLast);
         }
-        str = str.substr(cut_at + 1);
     }
-    if (str.length() > 0) {
-        vecstr_return.push_back(str);
+    DetectKeyFrame();
+    return true;
+}
+
+string Dataset::GetImgPath(int _id) const {
+    return mstrFoldPathImg + to_string(_id) + ".bmp";
+}
+
+bool Dataset::LoadOdoData() {
+    OdoParser parser;
+    if (!parser.Parse(mstrFilePathOdo, mvecOdo)) {
+        cerr << "Error in Dataset::LoadOdoData, fail to read " << mstrFilePathOdo << endl;
+        return false;
+    }
+    if (parser.GetNumBad() > 0 || parser.GetNumComment() > 0)
+        cerr << "Dataset::LoadOdoData: " << mvecOdo.size() << " records, "
+             << parser.GetNumComment() << " comment lines, "
+             << parser.GetNumBad() << " bad lines" << endl;
+    if (mvecOdo.empty()) {
+        cerr << "Error in Dataset::LoadOdoData, no odometry record in " << mstrFilePathOdo << endl;
+        return false;
+    }
+    return true;
+}
+
+bool Dataset::LoadCache() {
+    if (!mbUseCache)
+        return false;
+
+    vector<KfCache> vecKf;
+    if (!DetectCache::Load(mstrFilePathCache, ComputeCacheKey(), mvecOdo, vecKf)) {
+        mvecOdo.clear();
+        return false;
+    }
+
+    // rebuild keyframes and odometry measurements without any image
+    PtrKeyFrame pKeyFrameLast = nullptr;
+    for (const auto &kf : vecKf) {
+        Frame frame(Mat(), kf.odo, kf.id);
+        LinkKeyFrame(make_shared<KeyFrame>(frame, kf.vecMsrAruco), pKeyFrameLast);
+    }
+    cerr << "Dataset::LoadCache: detection results of " << vecKf.size() << " keyframes are read from "
+         << mstrFilePathCache << ", images are not decoded. Images are only checked by size and modification "
+         << "time, delete the file to detect again" << endl;
+    return true;
+}
+
+bool Dataset::SaveCache() {
+    if (!mbUseCache)
+        return false;
+
+    vector<KfCache> vecKf;
+    for (auto pKf : mstorKf) {
+        KfCache kf;
+        kf.id = pKf->GetId();
+        kf.odo = pKf->GetOdo();
+        kf.vecMsrAruco = pKf->GetMsrAruco();
+        vecKf.push_back(kf);
+    }
+
+    if (!DetectCache::Save(mstrFilePathCache, ComputeCacheKey(), mvecOdo, vecKf)) {
+        cerr << "Error in Dataset::SaveCache, fail to write " << mstrFilePathCache << endl;
+        return false;
+    }
+    cerr << "Dataset::SaveCache: detection results written to " << mstrFilePathCache << endl;
+    return true;
+}
+
+// The key covers everything the cached keyframes depend on: keyframe
+// selection, detector settings, camera config, odometry log and images.
+// The odometry log and the images are only hashed by size and modification
+// time, a file replaced with the same size and mtime is not noticed.
+uint64_t Dataset::ComputeCacheKey() const {
+    uint64_t key = DetectCache::Hash(nullptr, 0);
+
+    uint32_t version = DetectCache::VERSION;
+    double paramDataset[] = {
+        (double)mNumFrame, mMarkerSize, mThreshOdoLin, mThreshOdoRot,
+        (double)Config::DATASET_LOAD_MODE, (double)mFlagRead
+    };
+    key = DetectCache::Hash(&version, sizeof(version), key);
+    key = DetectCache::Hash(paramDataset, sizeof(paramDataset), key);
+
+    double thresParam1, thresParam2;
+    float minSize, maxSize;
+    mMDetector.getThresholdParams(thresParam1, thresParam2);
+    mMDetector.getMinMaxSize(minSize, maxSize);
+    double paramDetector[] = {
+        (double)mMDetector.getThresholdMethod(), thresParam1, thresParam2,
+        (double)mMDetector.getCornerRefinementMethod(), minSize, maxSize,
+        (double)mMDetector.getDesiredSpeed(), (double)mPyrDownLevel,
+        (double)mMDetector.isPlanarPoseEnabled(), (double)mMDetector.isHomographySamplingEnabled(),
+        (double)mMDetector.isFastLineFitEnabled(), (double)mNumDetectTile, mDetectTileOverlap
+    };
+    key = DetectCache::Hash(paramDetector, sizeof(paramDetector), key);
+
+    // the selected level is only known after detection, hash how it is selected
+    if (mPyrDownLevel < 0) {
+        double paramPyr[] = {mPyrMinMark, (double)mNumPyrProbe};
+        key = DetectCache::Hash(paramPyr, sizeof(paramPyr), key);
+    }
+
+    // tracking changes which regions are searched, so it can change the marks found
+    if (mbTrackDetect) {
+        double paramTrack[] = {
+            (double)mNumTrackFull, mTrackRoiMargin,
+            mSe3bcTrack.rvec.at<float>(0), mSe3bcTrack.rvec.at<float>(1), mSe3bcTrack.rvec.at<float>(2),
+            mSe3bcTrack.tvec.at<float>(0), mSe3bcTrack.tvec.at<float>(1), mSe3bcTrack.tvec.at<float>(2)
+        };
+        key = DetectCache::Hash(paramTrack, sizeof(paramTrack), key);
     }
-    return vecstr_return;
+
+    key = DetectCache::HashFileContent(mstrFilePathCam, key);
+    key = DetectCache::HashFileStat(mstrFilePathOdo, key);
+    for (int i = 0; i < mNumFrame; ++i)
+        key = DetectCache::HashFileStat(GetImgPath(i), key);
+    return key;
 }
 
 void Dataset::CreateKeyFrame() {
 
-    PtrKeyFrame pKeyFrameLast = make_shared<KeyFrame>(**msetpFrame.cbegin(), mCamParam, mMDetector, mMarkerSize);
-    InsertKf(pKeyFrameLast);
+    PtrKeyFrame pKeyFrameLast = nullptr;
+    for (auto ptr : mstorFrame) {
+        SelectKeyFrame(*ptr, pKeyFrameLast);
+    }
+    DetectKeyFrame();
+}
 
-    for (auto ptr : msetpFrame) {
-        PtrFrame pFrameNew = ptr;
-        Se2 dodo = pFrameNew->GetOdo() - pKeyFrameLast->GetOdo();
-        double dl = sqrt(dodo.x*dodo.x + dodo.y*dodo.y);
-        double dr = abs(dodo.theta);
-        Mat info = Mat::eye(3,3,CV_32FC1);
-        if (dl > mThreshOdoLin || dr > mThreshOdoRot) {
-            PtrKeyFrame pKeyFrameNew = make_shared<KeyFrame>(*pFrameNew, mCamParam, mMDetector, mMarkerSize);
-            InsertKf(pKeyFrameNew);
-            PtrMsrSe2Kf2Kf pMeasureOdo = make_shared<MeasureSe2Kf2Kf>(dodo, info, pKeyFrameLast, pKeyFrameNew);
-            msetMsrOdo.insert(pMeasureOdo);
-            pKeyFrameLast = pKeyFrameNew;
+// Keyframes are detected by a pool of workers taking segments of
+// keyframes in turn. Without tracking a segment is a single keyframe.
+// With tracking, the first keyframe of a segment is detected on the full
+// image and the next ones around the marks predicted from the previous
+// keyframe. A keyframe where a predicted mark is lost, or with nothing to
+// predict, is detected again on the full image. Segments are independent,
+// so the result does not depend on the number of threads.
+void Dataset::DetectKeyFrame() {
+    const vector<PtrKeyFrame> &vecpKf = mstorKf.Get();
+    if (vecpKf.empty())
+        return;
+    if (mPyrDownLevel < 0)
+        SelectPyrDownLevel();
+    int numKf = vecpKf.size();
+    int lenSeg = mbTrackDetect ? max(1, mNumTrackFull) : 1;
+    int numSeg = (numKf + lenSeg - 1) / lenSeg;
+    int numThread = mNumThreadDetect;
+    if (numThread <= 0)
+        numThread = max(1u, thread::hardware_concurrency());
+    numThread = min(numThread, numSeg);
+
+    // detector statistics of each worker, merged at the end, and the first
+    // exception other than cv::Exception of each worker, thrown again here
+    vector<MarkerDetector::Stats> vecStats(numThread);
+    vector<exception_ptr> vecError(numThread);
+    atomic<int> idxNext(0), numFull(0), numFail(0);
+    auto worker = [&](int idxWorker) {
+        // the detector is shared, scratch buffers belong to the worker
+        MarkerDetector::Workspace ws;
+        vector<Rect> vecRoi;
+        vector<int> vecIdExpect;
+        try {
+            for (int seg = idxNext++; seg < numSeg; seg = idxNext++) {
+                for (int idx = seg * lenSeg; idx < min((seg + 1) * lenSeg, numKf); ++idx) {
+                    KeyFrame &kf = *vecpKf[idx];
+                    try {
+                        bool bFull = idx == seg * lenSeg;
+                        if (!bFull)
+                            bFull = PredictMarkRoi(*vecpKf[idx - 1], kf, vecRoi, vecIdExpect) == 0;
+                        if (!bFull) {
+                            kf.DetectMsrAruco(mCamParam, mMDetector, ws, mMarkerSize, vecRoi);
+                            for (int id : vecIdExpect) {
+                                bool bFound = false;
+                                for (const auto &mk : kf.GetMsrAruco())
+                                    bFound = bFound || mk.id == id;
+                                bFull = bFull || !bFound;
+                            }
+                        }
+                        if (bFull) {
+                            kf.DetectMsrAruco(mCamParam, mMDetector, ws, mMarkerSize);
+                            ++numFull;
+                        }
+                    }
+                    catch (cv::Exception &e) {
+                        cerr << "Error in Dataset::DetectKeyFrame, keyframe " << kf.GetId()
+                             << ": " << e.what() << endl;
+                        ++numFail;
+                    }
+                }
+            }
+        }
+        catch (...) {
+            // the other workers take no more segments
+            vecError[idxWorker] = current_exception();
+            idxNext = numSeg;
         }
+        vecStats[idxWorker] = ws.stats;
+    };
+
+    // keyframes are the only level of parallelism when there are several
+    // workers, the detector then runs its parallel loops in the calling thread
+    int numThreadCv = getNumThreads();
+    if (numThread > 1)
+        setNumThreads(1);
+    vector<thread> vecThread;
+    for (int i = 1; i < numThread; ++i)
+        vecThread.push_back(thread(worker, i));
+    worker(0);
+    for (auto &t : vecThread)
+        t.join();
+    setNumThreads(numThreadCv);
+    for (const auto &pError : vecError)
+        if (pError)
+            rethrow_exception(pError);
+
+    if (numFail > 0)
+        cerr << "Error in Dataset::DetectKeyFrame, detection failed in " << numFail.load()
+             << " of " << numKf << " keyframes, they have no mark measurement" << endl;
+
+    mDetectStats.clear();
+    for (const auto &stats : vecStats)
+        mDetectStats.add(stats);
+    const MarkerDetector::Stats &st = mDetectStats;
+
+    if (mbWriteDetectStats) {
+        // with tracking a keyframe can take two detections, the region pass
+        // and the full image pass, so times are given per detection
+        double msPerCall = st.calls > 0 ? 1000.0 / st.calls : 0;
+        cerr << "Dataset::DetectKeyFrame: " << numKf << " keyframes, " << st.calls << " detections, "
+             << numFull.load() << " on full image, " << numThread << " threads, "
+             << "ms per detection: preprocess " << st.time[MarkerDetector::Stats::PREPROCESS] * msPerCall
+             << ", find rectangles " << st.time[MarkerDetector::Stats::FIND_RECT] * msPerCall
+             << ", identify " << st.time[MarkerDetector::Stats::IDENTIFY] * msPerCall
+             << ", reconstruction " << st.time[MarkerDetector::Stats::RECONSTRUCTION] * msPerCall << endl;
+        cerr << "Dataset::DetectKeyFrame: " << st.contours << " contours, " << st.candidates << " candidates, "
+             << st.identified << " identified, " << st.duplicates << " duplicates" << endl;
+
+        string strCsv = mstrFilePathDetectStats + ".csv";
+        string strJson = mstrFilePathDetectStats + ".json";
+        if (!DetectStats::WriteCsv(strCsv, st, numKf) || !DetectStats::WriteJson(strJson, st, numKf))
+            cerr << "Error in Dataset::DetectKeyFrame, fail to write " << strCsv << " or " << strJson << endl;
     }
 }
 
-bool Dataset::InsertFrame(PtrFrame ptr) {
-    int id = ptr->GetId();
-    if(mmapId2pFrame.count(id)) {
-        return false;
+// Select the pyramid level from the marks found at full resolution in a few
+// keyframes spread over the dataset. The side of a mark is the shortest of
+// its image sides and of its size projected at its depth, the level is
+// raised while the smallest side stays above mPyrMinMark pixels.
+void Dataset::SelectPyrDownLevel() {
+    const vector<PtrKeyFrame> &vecpKf = mstorKf.Get();
+    const int maxLevel = 3;
+
+    MarkerDetector detector;
+    ConfigDetector(detector);
+    MarkerDetector::Workspace ws;
+    float fx = mCamParam.CameraMatrix.at<float>(0,0);
+    float sideMin = numeric_limits<float>::max();
+    int numMk = 0;
+    int numProbe = min(mNumPyrProbe, (int)vecpKf.size());
+    for (int i = 0; i < numProbe; ++i) {
+        const KeyFrame &kf = *vecpKf[i * vecpKf.size() / numProbe];
+        vector<Marker> vecMk;
+        try {
+            detector.detect(kf.GetImg(), vecMk, ws, mCamParam, mMarkerSize);
+        }
+        catch (cv::Exception &e) {
+            cerr << "Error in Dataset::SelectPyrDownLevel, keyframe " << kf.GetId()
+                 << ": " << e.what() << endl;
+        }
+        for (const auto &mk : vecMk) {
+            float side = numeric_limits<float>::max();
+            for (int c = 0; c < 4; ++c)
+                side = min(side, (float)norm(mk[c] - mk[(c+1)%4]));
+            if (mk.Tvec.rows == 3 && mk.Tvec.at<float>(2) > 0)
+                side = min(side, fx * (float)mMarkerSize / mk.Tvec.at<float>(2));
+            sideMin = min(sideMin, side);
+            ++numMk;
+        }
+    }
+
+    int level = 0;
+    if (numMk > 0) {
+        while (level < maxLevel && sideMin / (2 << level) >= mPyrMinMark)
+            ++level;
+    }
+    mMDetector.pyrDown(level);
+    cerr << "Dataset::SelectPyrDownLevel: " << numMk << " marks in " << numProbe << " keyframes, "
+         << "smallest side " << (numMk > 0 ? sideMin : 0) << " px, level " << level << endl;
+}
+
+// Move the marks of the last keyframe into the new one, with the odometry
+// between them and the extrinsic guess. Returns the number of marks that
+// should be fully visible, their ids are in _vecIdExpect. Odometry, mark
+// size and extrinsic share the same unit.
+int Dataset::PredictMarkRoi(const KeyFrame &_kfLast, const KeyFrame &_kf,
+                            vector<Rect> &_vecRoi, vector<int> &_vecIdExpect) const {
+    _vecRoi.clear();
+    _vecIdExpect.clear();
+
+    // camera motion from the last keyframe to the new one
+    Se2 se2odoLast = _kfLast.GetOdo();
+    Se3 se3bb = Se3(se2odoLast - _kf.GetOdo());
+    Mat Tbc = mSe3bcTrack.T();
+    Mat Tcc = Tbc.inv() * se3bb.T() * Tbc;
+    Mat Rcc = Tcc.rowRange(0,3).colRange(0,3);
+    Mat tcc = Tcc.rowRange(0,3).col(3);
+
+    // center of each mark in the new camera, and its radius in the last image
+    // scaled by the change of depth
+    vector<Point3f> vecCenter;
+    vector<float> vecRadius;
+    vector<int> vecId;
+    for (const auto &mk : _kfLast.GetMsrAruco()) {
+        if (mk.Tvec.rows != 3)
+            continue;
+        Mat tcm = Rcc * mk.Tvec + tcc;
+        float zLast = mk.Tvec.at<float>(2);
+        float z = tcm.at<float>(2);
+        if (zLast <= 0 || z <= 0)
+            continue;
+        Point2f center = mk.getCenter();
+        float radius = 0;
+        for (const auto &pt : mk)
+            radius = max(radius, (float)norm(pt - center));
+        vecCenter.push_back(Point3f(tcm.at<float>(0), tcm.at<float>(1), z));
+        vecRadius.push_back(radius * zLast / z);
+        vecId.push_back(mk.id);
+    }
+    if (vecCenter.empty())
+        return 0;
+
+    vector<Point2f> vecPt;
+    Mat zero = Mat::zeros(3, 1, CV_32FC1);
+    projectPoints(vecCenter, zero, zero, mCamParam.CameraMatrix, mCamParam.Distorsion, vecPt);
+
+    Rect rectImg(Point(0,0), _kf.GetImg().size());
+    for (size_t i = 0; i < vecPt.size(); ++i) {
+        const Point2f &pt = vecPt[i];
+        float r = vecRadius[i];
+        float rRoi = r * (1 + mTrackRoiMargin);
+        Rect roi(cvFloor(pt.x - rRoi), cvFloor(pt.y - rRoi), cvCeil(2 * rRoi), cvCeil(2 * rRoi));
+        if ((roi & rectImg).area() == 0)
+            continue;
+        _vecRoi.push_back(roi);
+        // a mark cut by the image border may be lost, it is not expected
+        Rect rectMk(cvFloor(pt.x - r), cvFloor(pt.y - r), cvCeil(2 * r), cvCeil(2 * r));
+        if ((rectMk & rectImg) == rectMk)
+            _vecIdExpect.push_back(vecId[i]);
     }
+    return _vecIdExpect.size();
+}
+
+bool Dataset::IsKeyFrame(const Se2 &_odo, const Se2 &_odoKfLast) const {
+    Se2 dodo = Se2(_odo) - _odoKfLast;
+    double dl = sqrt(dodo.x*dodo.x + dodo.y*dodo.y);
+    double dr = abs(dodo.theta);
+    return dl > mThreshOdoLin || dr > mThreshOdoRot;
+}
+
+bool Dataset::SelectKeyFrame(const Frame &_f, PtrKeyFrame &_pKfLast) {
 
-    msetpFrame.insert(ptr);
-    mmapId2pFrame[id] = ptr;
+    // the first frame is always a keyframe
+    if (_pKfLast && !IsKeyFrame(_f.GetOdo(), _pKfLast->GetOdo()))
+        return false;
+    AddKeyFrame(_f, _pKfLast);
     return true;
 }
 
+void Dataset::AddKeyFrame(const Frame &_f, PtrKeyFrame &_pKfLast) {
+    PtrKeyFrame pKeyFrameNew = make_shared<KeyFrame>(_f);
+    LinkKeyFrame(pKeyFrameNew, _pKfLast);
+}
+
+void Dataset::LinkKeyFrame(PtrKeyFrame _pKfNew, PtrKeyFrame &_pKfLast) {
+    InsertKf(_pKfNew);
+    if (_pKfLast) {
+        Se2 dodo = _pKfNew->GetOdo() - _pKfLast->GetOdo();
+        Mat info = Mat::eye(3,3,CV_32FC1);
+        PtrMsrSe2Kf2Kf pMeasureOdo = make_shared<MeasureSe2Kf2Kf>(dodo, info, _pKfLast, _pKfNew);
+        msetMsrOdo.insert(pMeasureOdo);
+    }
+    _pKfLast = _pKfNew;
+}
+
+bool Dataset::InsertFrame(PtrFrame ptr) {
+    return mstorFrame.Insert(ptr);
+}
+
 bool Dataset::DeleteFrame(PtrFrame ptr) {
-    auto iter = msetpFrame.find(ptr);
-    if (iter == msetpFrame.cend()) {
+    if (mstorFrame.Find(ptr->GetId()) != ptr) {
         return false;
     }
-    msetpFrame.erase(iter);
-    mmapId2pFrame.erase(ptr->GetId());
-    return true;
+    return mstorFrame.Erase(ptr->GetId());
 }
 
 bool Dataset::InsertKf(PtrKeyFrame ptr) {
-    int id = ptr->GetId();
-    if(mmapId2pKf.count(id)) {
-        return false;
-    }
-    msetpKf.insert(ptr);
-    mmapId2pKf[id] = ptr;
-    return true;
+    return mstorKf.Insert(ptr);
 }
 
 bool Dataset::DeleteKf(PtrKeyFrame ptr) {
-    auto iter = msetpKf.find(ptr);
-    if (iter == msetpKf.cend()) {
+    if (mstorKf.Find(ptr->GetId()) != ptr) {
         return false;
     }
-    msetpKf.erase(iter);
-    mmapId2pKf.erase(ptr->GetId());
-    return true;
+    return mstorKf.Erase(ptr->GetId());
 }
 
 
 bool Dataset::InsertMk(PtrArucoMark& ptr) {
-    int id = ptr->GetId();
-    if(mmapId2pMk.count(id)) {
-        ptr = mmapId2pMk[id];
+    PtrArucoMark pMkOld = mstorMk.Find(ptr->GetId());
+    if (pMkOld) {
+        ptr = pMkOld;
         return false;
     }
-    msetpMk.insert(ptr);
-    mmapId2pMk[id] = ptr;
-    return true;
+    return mstorMk.Insert(ptr);
 }
 
 bool Dataset::DeleteMk(PtrArucoMark ptr) {
-    auto iter = msetpMk.find(ptr);
-    if (iter == msetpMk.cend()) {
+    if (mstorMk.Find(ptr->GetId()) != ptr) {
         return false;
     }
-    msetpMk.erase(iter);
-    mmapId2pMk.erase(ptr->GetId());
-    return true;
+    return mstorMk.Erase(ptr->GetId());
 }
 
 PtrArucoMark Dataset::FindMk(int id) {
-    auto iter = mmapId2pMk.find(id);
-    if (iter != mmapId2pMk.cend())
-        return iter->second;
-    else
-        return nullptr;
+    return mstorMk.Find(id);
 }
 
 void Dataset::CreateMarkMeasure() {
 
-    for (auto pkf : msetpKf) {
+    for (auto pkf : mstorKf) {
         const vector<Marker>& vecMeasureAruco = pkf->GetMsrAruco();
         for (auto measure_aruco : vecMeasureAruco) {
             // read data from aruco detect
@@ -230,7 +658,7 @@ bool Dataset::InsertMsrMk(PtrMsrKf2AMk pmsr) {
 }
 
 void Dataset::InitKf(Se3 _se3bc) {
-    for(auto ptr : msetpKf) {
+    for(auto ptr : mstorKf) {
         PtrKeyFrame pKf = ptr;
 
         Se2 se2odo = pKf->GetOdo();
@@ -252,7 +680,7 @@ void Dataset::InitKf(Se3 _se3bc) {
 }
 
 void Dataset::InitMk() {
-    for(auto ptr : msetpMk) {
+    for(auto ptr : mstorMk) {
         PtrArucoMark pMk = ptr;
         set<PtrMsrKf2AMk> setpMsr = pMk->GetMsr();
         if(!setpMsr.empty()) {
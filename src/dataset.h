@@ -2,6 +2,7 @@
 #define DATASET_H
 
 #include "type.h"
+#include "odoparser.h"
 #include "aruco/aruco.h"
 
 namespace calibcamodo {
@@ -13,12 +14,24 @@ class Dataset {
 
 public:
 
+    // how frames are loaded from disk, see Config::DATASET_LOAD_MODE
+    enum LoadMode {
+        LOAD_ALL = 0,       // keep all frames in memory, then select keyframes
+        LOAD_STREAM = 1,    // select keyframes while reading, drop other frames
+        LOAD_ODOFIRST = 2   // select keyframes by odometry, then decode them
+    };
+
     Dataset();
     Dataset(string _strFolderPathMain, int _numFrame, double _markerSize);
     ~Dataset();
 
-    void CreateFrame();
+    // return false if the odometry log can not be loaded
+    bool CreateFrame();
     void CreateKeyFrame();
+    bool CreateKeyFrameStream();
+    bool CreateKeyFrameOdoFirst();
+    bool LoadCache();
+    bool SaveCache();
     void CreateMarkMeasure();
 
     void InitKf(Se3 _se3bc);
@@ -28,31 +41,38 @@ public:
         InitMk();
     }
 
-    inline const set<PtrFrame> & GetFrame() const { return msetpFrame; }
+    // frames, keyframes and marks are returned in id order
+    inline const vector<PtrFrame> & GetFrame() const { return mstorFrame.Get(); }
+    inline PtrFrame GetFrame(int _id) const { return mstorFrame.Find(_id); }
 
-    inline const set<PtrKeyFrame> & GetKfSet() const { return msetpKf; }
-    inline const map<int, PtrKeyFrame> & GetKfMap() const { return mmapId2pKf; }
+    inline const vector<PtrKeyFrame> & GetKfSet() const { return mstorKf.Get(); }
+    inline PtrKeyFrame GetKf(int _id) const { return mstorKf.Find(_id); }
 
-    inline const set<PtrArucoMark> & GetMkSet() const { return msetpMk; }
-    inline const map<int, PtrArucoMark> & GetMkMap() const {return mmapId2pMk; }
+    inline const vector<PtrArucoMark> & GetMkSet() const { return mstorMk.Get(); }
+    inline PtrArucoMark GetMk(int _id) const { return mstorMk.Find(_id); }
 
     inline const set<PtrMsrKf2AMk> & GetMsrMk() const { return msetMsrMk; }
     inline const set<PtrMsrSe2Kf2Kf> & GetMsrOdo() const { return msetMsrOdo; }
 
+    // extrinsic used to predict marks in tracking detection, tracking asked
+    // in the config is only enabled with a guess
+    void SetTrackExtrinsic(const Se3 &_se3bc);
+    inline Se3 GetTrackExtrinsic() const { return mSe3bcTrack; }
+
+    // detector statistics of the last keyframe detection
+    inline const aruco::MarkerDetector::Stats & GetDetectStats() const { return mDetectStats; }
+
 private:
 
-    set<PtrFrame> msetpFrame;
-    map<int, PtrFrame> mmapId2pFrame;
+    IdStore<Frame> mstorFrame;
     bool InsertFrame(PtrFrame ptr);
     bool DeleteFrame(PtrFrame ptr);
 
-    set<PtrKeyFrame> msetpKf;
-    map<int, PtrKeyFrame> mmapId2pKf;
+    IdStore<KeyFrame> mstorKf;
     bool InsertKf(PtrKeyFrame ptr);
     bool DeleteKf(PtrKeyFrame ptr);
 
-    set<PtrArucoMark> msetpMk;
-    map<int, PtrArucoMark> mmapId2pMk;
+    IdStore<ArucoMark> mstorMk;
     bool InsertMk(PtrArucoMark& ptr);
     bool DeleteMk(PtrArucoMark ptr);
     PtrArucoMark FindMk(int id);
@@ -67,6 +87,29 @@ private:
 
     aruco::CameraParameters mCamParam;
     aruco::MarkerDetector mMDetector;
+    void ConfigDetector(aruco::MarkerDetector &_detector) const;
+
+    int mNumThreadDetect;
+    void DetectKeyFrame();
+
+    int mNumDetectTile;
+    double mDetectTileOverlap;
+
+    bool mbWriteDetectStats;
+    string mstrFilePathDetectStats;
+    aruco::MarkerDetector::Stats mDetectStats;
+
+    int mPyrDownLevel;
+    double mPyrMinMark;
+    int mNumPyrProbe;
+    void SelectPyrDownLevel();
+
+    bool mbTrackDetect;
+    int mNumTrackFull;
+    double mTrackRoiMargin;
+    Se3 mSe3bcTrack;
+    int PredictMarkRoi(const KeyFrame &_kfLast, const KeyFrame &_kf,
+                       vector<cv::Rect> &_vecRoi, vector<int> &_vecIdExpect) const;
 
     string mstrFoldPathMain;
     string mstrFoldPathImg;
@@ -79,8 +122,21 @@ private:
     double mThreshOdoLin;
     double mThreshOdoRot;
 
-    vector<string> SplitString(const string _str, const string _separator);
-    bool ParseOdoData(const string _str, Se2 &_odo, int &_id);
+    int mNumThreadLoad;
+    int mNumBufferLoad;
+    int mFlagRead;
+    bool IsKeyFrame(const Se2 &_odo, const Se2 &_odoKfLast) const;
+    bool SelectKeyFrame(const Frame &_f, PtrKeyFrame &_pKfLast);
+    void AddKeyFrame(const Frame &_f, PtrKeyFrame &_pKfLast);
+    void LinkKeyFrame(PtrKeyFrame _pKfNew, PtrKeyFrame &_pKfLast);
+
+    vector<OdoRecord> mvecOdo;
+    bool LoadOdoData();
+    string GetImgPath(int _id) const;
+
+    bool mbUseCache;
+    string mstrFilePathCache;
+    uint64_t ComputeCacheKey() const;
 };
 
 }
@@ -0,0 +1,182 @@
+#include "detectcache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <sys/stat.h>
+
+namespace calibcamodo {
+
+using namespace std;
+using namespace cv;
+using namespace aruco;
+
+namespace {
+
+const char CACHE_MAGIC[8] = {'C','A','L','I','B','D','E','T'};
+
+// sanity bounds when reading, a corrupted file must not allocate wildly
+const uint32_t MAX_NUM_ODO = 1u << 28;
+const uint32_t MAX_NUM_KF = 1u << 24;
+const uint32_t MAX_NUM_MK = 4096;
+
+template<typename T>
+inline void Write(ofstream &_os, const T &_val) {
+    _os.write(reinterpret_cast<const char*>(&_val), sizeof(T));
+}
+
+template<typename T>
+inline bool Read(ifstream &_is, T &_val) {
+    _is.read(reinterpret_cast<char*>(&_val), sizeof(T));
+    return _is.good();
+}
+
+void WriteVec3f(ofstream &_os, const Mat &_vec) {
+    Mat vec;
+    _vec.convertTo(vec, CV_32F);
+    for (int i = 0; i < 3; ++i)
+        Write(_os, vec.ptr<float>(0)[i]);
+}
+
+bool ReadVec3f(ifstream &_is, Mat &_vec) {
+    _vec.create(3, 1, CV_32FC1);
+    for (int i = 0; i < 3; ++i)
+        if (!Read(_is, _vec.at<float>(i,0)))
+            return false;
+    return true;
+}
+
+}
+
+bool DetectCache::Load(const string &_strFilePath, uint64_t _key,
+                       vector<OdoRecord> &_vecOdo, vector<KfCache> &_vecKf) {
+
+    ifstream is(_strFilePath, ios::binary);
+    if (!is.is_open())
+        return false;
+
+    char magic[8];
+    uint32_t version;
+    uint64_t key;
+    is.read(magic, sizeof(magic));
+    if (!is.good() || !equal(magic, magic+8, CACHE_MAGIC))
+        return false;
+    if (!Read(is, version) || version != VERSION)
+        return false;
+    if (!Read(is, key) || key != _key)
+        return false;
+
+    // odometry
+    uint32_t numOdo;
+    if (!Read(is, numOdo) || numOdo > MAX_NUM_ODO)
+        return false;
+    _vecOdo.resize(numOdo);
+    for (auto &rec : _vecOdo) {
+        if (!Read(is, rec.id) || !Read(is, rec.odo.x) || !Read(is, rec.odo.y) || !Read(is, rec.odo.theta))
+            return false;
+    }
+
+    // keyframes and their aruco measurements
+    uint32_t numKf;
+    if (!Read(is, numKf) || numKf > MAX_NUM_KF)
+        return false;
+    _vecKf.resize(numKf);
+    for (auto &kf : _vecKf) {
+        uint32_t numMk;
+        if (!Read(is, kf.id) || !Read(is, kf.odo.x) || !Read(is, kf.odo.y) || !Read(is, kf.odo.theta))
+            return false;
+        if (!Read(is, numMk) || numMk > MAX_NUM_MK)
+            return false;
+        kf.vecMsrAruco.resize(numMk);
+        for (auto &mk : kf.vecMsrAruco) {
+            mk.resize(4);
+            if (!Read(is, mk.id) || !Read(is, mk.ssize))
+                return false;
+            for (int i = 0; i < 4; ++i)
+                if (!Read(is, mk[i].x) || !Read(is, mk[i].y))
+                    return false;
+            if (!ReadVec3f(is, mk.Rvec) || !ReadVec3f(is, mk.Tvec))
+                return false;
+        }
+    }
+    return true;
+}
+
+bool DetectCache::Save(const string &_strFilePath, uint64_t _key,
+                       const vector<OdoRecord> &_vecOdo, const vector<KfCache> &_vecKf) {
+
+    // write to a temporary file first, an interrupted run leaves no broken cache
+    string strFileTmp = _strFilePath + ".tmp";
+    ofstream os(strFileTmp, ios::binary | ios::trunc);
+    if (!os.is_open())
+        return false;
+
+    uint32_t version = VERSION;
+    os.write(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    Write(os, version);
+    Write(os, _key);
+
+    Write(os, (uint32_t)_vecOdo.size());
+    for (const auto &rec : _vecOdo) {
+        Write(os, rec.id);
+        Write(os, rec.odo.x);
+        Write(os, rec.odo.y);
+        Write(os, rec.odo.theta);
+    }
+
+    Write(os, (uint32_t)_vecKf.size());
+    for (const auto &kf : _vecKf) {
+        Write(os, kf.id);
+        Write(os, kf.odo.x);
+        Write(os, kf.odo.y);
+        Write(os, kf.odo.theta);
+        Write(os, (uint32_t)kf.vecMsrAruco.size());
+        for (const auto &mk : kf.vecMsrAruco) {
+            Write(os, mk.id);
+            Write(os, mk.ssize);
+            for (int i = 0; i < 4; ++i) {
+                Write(os, mk[i].x);
+                Write(os, mk[i].y);
+            }
+            WriteVec3f(os, mk.Rvec);
+            WriteVec3f(os, mk.Tvec);
+        }
+    }
+
+    os.close();
+    if (os.fail())
+        return false;
+    return rename(strFileTmp.c_str(), _strFilePath.c_str()) == 0;
+}
+
+uint64_t DetectCache::Hash(const void *_pData, size_t _size, uint64_t _seed) {
+    const unsigned char *p = static_cast<const unsigned char*>(_pData);
+    uint64_t h = _seed;
+    for (size_t i = 0; i < _size; ++i) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t DetectCache::HashFileContent(const string &_strFilePath, uint64_t _seed) {
+    ifstream is(_strFilePath, ios::binary);
+    if (!is.is_open())
+        return Hash(_strFilePath.data(), _strFilePath.size(), _seed);
+    string content((istreambuf_iterator<char>(is)), istreambuf_iterator<char>());
+    return Hash(content.data(), content.size(), _seed);
+}
+
+uint64_t DetectCache::HashFileStat(const string &_strFilePath, uint64_t _seed) {
+    struct stat st;
+    int64_t info[3] = {-1, 0, 0};
+    if (stat(_strFilePath.c_str(), &st) == 0) {
+        info[0] = st.st_size;
+        info[1] = st.st_mtim.tv_sec;
+        info[2] = st.st_mtim.tv_nsec;
+    }
+    return Hash(info, sizeof(info), _seed);
+}
+
+}
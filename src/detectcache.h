@@ -0,0 +1,45 @@
+#ifndef DETECTCACHE_H
+#define DETECTCACHE_H
+
+#include "type.h"
+#include "odoparser.h"
+#include "aruco/aruco.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace calibcamodo {
+
+// keyframe data kept in the detection cache
+struct KfCache {
+    int id;
+    Se2 odo;
+    std::vector<aruco::Marker> vecMsrAruco;
+};
+
+// Versioned binary file with the odometry, the keyframe ids and the aruco
+// detection results of each keyframe, so that a re-run can skip image
+// decoding and marker detection. The file is only accepted if it was
+// written with the same key, see Dataset::ComputeCacheKey. Large inputs are
+// keyed by file metadata, not content, so the cache is off by default
+// (Config::DATASET_USE_CACHE).
+class DetectCache {
+public:
+    static const uint32_t VERSION = 1;
+
+    static bool Load(const std::string &_strFilePath, uint64_t _key,
+                     std::vector<OdoRecord> &_vecOdo, std::vector<KfCache> &_vecKf);
+    static bool Save(const std::string &_strFilePath, uint64_t _key,
+                     const std::vector<OdoRecord> &_vecOdo, const std::vector<KfCache> &_vecKf);
+
+    // FNV-1a, used to build the cache key
+    static uint64_t Hash(const void *_pData, size_t _size, uint64_t _seed = 14695981039346656037ULL);
+    // hash of file content, or of the path only if the file can not be read
+    static uint64_t HashFileContent(const std::string &_strFilePath, uint64_t _seed);
+    // hash of file size and modification time, cheap for large files
+    static uint64_t HashFileStat(const std::string &_strFilePath, uint64_t _seed);
+};
+
+}
+#endif // DETECTCACHE_H
@@ -0,0 +1,101 @@
+#include "detectstats.h"
+
+#include <cmath>
+#include <fstream>
+#include <utility>
+#include <vector>
+
+namespace calibcamodo {
+
+using namespace std;
+using namespace aruco;
+
+namespace {
+
+typedef MarkerDetector::Stats Stats;
+
+vector<pair<const char*, long> > GetCounters(const Stats &_stats) {
+    vector<pair<const char*, long> > vecCounter = {
+        {"calls", _stats.calls},
+        {"contours", _stats.contours},
+        {"rejected_size", _stats.rejectedSize},
+        {"rejected_polygon", _stats.rejectedPolygon},
+        {"rejected_convex", _stats.rejectedConvex},
+        {"rejected_side", _stats.rejectedSide},
+        {"rejected_near", _stats.rejectedNear},
+        {"candidates", _stats.candidates},
+        {"rejected_warp", _stats.rejectedWarp},
+        {"rejected_id", _stats.rejectedId},
+        {"identified", _stats.identified},
+        {"duplicates", _stats.duplicates},
+        {"rejected_tile_edge", _stats.rejectedTileEdge},
+        {"line_fit_unrefined", _stats.lineFitUnrefined}
+    };
+    return vecCounter;
+}
+
+}
+
+bool DetectStats::WriteCsv(const string &_strFilePath, const Stats &_stats, int _numKf) {
+    ofstream os(_strFilePath, ios::trunc);
+    if (!os.is_open())
+        return false;
+
+    os << "section,name,upper_ms,value" << endl;
+    os << "count,keyframes,," << _numKf << endl;
+    for (const auto &counter : GetCounters(_stats))
+        os << "count," << counter.first << ",," << counter.second << endl;
+    for (int s = 0; s < Stats::NUM_STAGES; ++s)
+        os << "time_ms," << Stats::stageName(s) << ",," << _stats.time[s] * 1000 << endl;
+    for (int s = 0; s < Stats::NUM_STAGES; ++s) {
+        for (int b = 0; b < Stats::NumTimeBins; ++b) {
+            double edge = Stats::timeBinEdge(b);
+            os << "hist," << Stats::stageName(s) << ",";
+            if (std::isinf(edge))
+                os << "inf";
+            else
+                os << edge * 1000;
+            os << "," << _stats.timeHist[s][b] << endl;
+        }
+    }
+    return os.good();
+}
+
+bool DetectStats::WriteJson(const string &_strFilePath, const Stats &_stats, int _numKf) {
+    ofstream os(_strFilePath, ios::trunc);
+    if (!os.is_open())
+        return false;
+
+    os << "{" << endl;
+    os << "  \"keyframes\": " << _numKf << "," << endl;
+    os << "  \"counters\": {";
+    vector<pair<const char*, long> > vecCounter = GetCounters(_stats);
+    for (size_t i = 0; i < vecCounter.size(); ++i)
+        os << (i ? ", " : "") << "\"" << vecCounter[i].first << "\": " << vecCounter[i].second;
+    os << "}," << endl;
+    // upper edge of the last bin is infinite, written as null
+    os << "  \"hist_upper_ms\": [";
+    for (int b = 0; b < Stats::NumTimeBins; ++b) {
+        double edge = Stats::timeBinEdge(b);
+        os << (b ? ", " : "");
+        if (std::isinf(edge))
+            os << "null";
+        else
+            os << edge * 1000;
+    }
+    os << "]," << endl;
+    os << "  \"stages\": {" << endl;
+    for (int s = 0; s < Stats::NUM_STAGES; ++s) {
+        double meanMs = _stats.calls > 0 ? _stats.time[s] * 1000 / _stats.calls : 0;
+        os << "    \"" << Stats::stageName(s) << "\": {\"total_ms\": " << _stats.time[s] * 1000
+           << ", \"mean_ms\": " << meanMs << ", \"hist\": [";
+        for (int b = 0; b < Stats::NumTimeBins; ++b)
+            os << (b ? ", " : "") << _stats.timeHist[s][b];
+        os << "]}" << (s + 1 < Stats::NUM_STAGES ? "," : "") << endl;
+    }
+    os << "  }" << endl;
+    os << "}" << endl;
+    return os.good();
+}
+
+}
@@ -0,0 +1,22 @@
+#ifndef DETECTSTATS_H
+#define DETECTSTATS_H
+
+#include "aruco/aruco.h"
+
+#include <string>
+
+namespace calibcamodo {
+
+// Dump of the marker detector statistics of a dataset run, to see where
+// the detection time goes and which filters reject the contours. Times
+// are written in milliseconds. The csv file is a long table with columns
+// section, name, upper_ms and value; the histogram rows give the upper
+// edge of each bin, "inf" for the last one.
+class DetectStats {
+public:
+    static bool WriteCsv(const std::string &_strFilePath, const aruco::MarkerDetector::Stats &_stats, int _numKf);
+    static bool WriteJson(const std::string &_strFilePath, const aruco::MarkerDetector::Stats &_stats, int _numKf);
+};
+
+}
+#endif
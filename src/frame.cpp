@@ -1,5 +1,7 @@
 #include "frame.h"
 
+#include <opencv2/imgproc/imgproc.hpp>
+
 namespace calibcamodo {
 
 using namespace cv;
@@ -7,30 +9,72 @@ using namespace std;
 using namespace aruco;
 
 // Class Frame
+// Frames only share the reference counted image buffer, pixels are never
+// copied. The buffer is never written after loading: GetImg only gives a
+// const reference, and GetImgAruco draws on its own copy.
 Frame::Frame(const cv::Mat &_im, const Se2& _odo, int _id) :
-    mOdo(_odo), mId(_id) {
-    _im.copyTo(mImg);
-}
+    mOdo(_odo), mId(_id), mImg(_im) {}
 
 Frame::Frame(const Frame &_f) :
-    mOdo(_f.mOdo), mId(_f.mId) {
-    _f.mImg.copyTo(mImg);
+    mOdo(_f.mOdo), mId(_f.mId), mImg(_f.mImg) {}
+
+Frame& Frame::operator= (const Frame& _f) {
+    mId = _f.mId;
+    mImg = _f.mImg;
+    mOdo = _f.mOdo;
+    return *this;
 }
 
 // Class KeyFrame
-KeyFrame::KeyFrame(const Frame& _f,
-                   CameraParameters &_CamParam,
-                   MarkerDetector &_MarkerDetector,
-                   double _marksize):
+KeyFrame::KeyFrame(const Frame& _f):
     Frame(_f), mpMsrOdoNext(nullptr), mpMsrOdoLast(nullptr) {
 
     mSe2wb = mOdo;
     mSe3wc = Se3();
-    _MarkerDetector.detect(mImg, mvecMsrAruco, _CamParam, _marksize);
-    mImg.copyTo(mImgAruco);
-    for (auto mk : mvecMsrAruco) {
-        mk.draw(mImgAruco, Scalar(0,0,255), 2);
+}
+
+KeyFrame::KeyFrame(const Frame& _f,
+                   const vector<Marker> &_vecMsrAruco):
+    Frame(_f), mvecMsrAruco(_vecMsrAruco), mpMsrOdoNext(nullptr), mpMsrOdoLast(nullptr) {
+
+    mSe2wb = mOdo;
+    mSe3wc = Se3();
+}
+
+void KeyFrame::DetectMsrAruco(const CameraParameters &_CamParam,
+                              const MarkerDetector &_MarkerDetector,
+                              MarkerDetector::Workspace &_ws,
+                              double _marksize) {
+    _MarkerDetector.detect(mImg, mvecMsrAruco, _ws, _CamParam, _marksize);
+    lock_guard<mutex> lock(mMutexImgAruco);
+    mImgAruco.release();
+}
+
+void KeyFrame::DetectMsrAruco(const CameraParameters &_CamParam,
+                              const MarkerDetector &_MarkerDetector,
+                              MarkerDetector::Workspace &_ws,
+                              double _marksize,
+                              const vector<Rect> &_vecRoi) {
+    _MarkerDetector.detect(mImg, mvecMsrAruco, _ws, _vecRoi, _CamParam, _marksize);
+    lock_guard<mutex> lock(mMutexImgAruco);
+    mImgAruco.release();
+}
+
+// The marker image is only rendered when it is first asked for, always in
+// colour, grey images are only converted back to BGR here. It is not
+// modified after rendering, so the cached image is shared with the caller.
+Mat KeyFrame::GetImgAruco() const {
+    lock_guard<mutex> lock(mMutexImgAruco);
+    if (mImgAruco.empty() && !mImg.empty()) {
+        if (mImg.type() == CV_8UC1)
+            cvtColor(mImg, mImgAruco, CV_GRAY2BGR);
+        else
+            mImg.copyTo(mImgAruco);
+        for (auto mk : mvecMsrAruco) {
+            mk.draw(mImgAruco, Scalar(0,0,255), 2);
+        }
     }
+    return mImgAruco;
 }
 
 void KeyFrame::InsertMsrMk(PtrMsrKf2AMk pmsr) {
@@ -5,6 +5,8 @@
 #include "measure.h"
 #include "aruco/aruco.h"
 
+#include <mutex>
+
 namespace calibcamodo {
 
 class Frame {
@@ -16,7 +18,9 @@ public:
     ~Frame() = default;
 
     virtual int GetId() const { return mId; }
-    virtual cv::Mat GetImg() const { return mImg; }
+    // the image buffer is shared with copies of this frame, so it is only
+    // exposed read only, clone it to get an image to modify
+    virtual const cv::Mat & GetImg() const { return mImg; }
     virtual Se2 GetOdo() const { return mOdo; }
 
 protected:
@@ -29,15 +33,29 @@ class KeyFrame: public Frame
 {
 public:
     KeyFrame() {}
+    KeyFrame(const Frame& _f);
     KeyFrame(const Frame& _f,
-             aruco::CameraParameters &_CamParam,
-             aruco::MarkerDetector &_MarkerDetector,
-             double markSize);
+             const std::vector<aruco::Marker> &_vecMsrAruco);
 
     ~KeyFrame() {}
 
+    // detect aruco marks in the keyframe image, the workspace is only used
+    // by the calling thread
+    void DetectMsrAruco(const aruco::CameraParameters &_CamParam,
+                        const aruco::MarkerDetector &_MarkerDetector,
+                        aruco::MarkerDetector::Workspace &_ws,
+                        double markSize);
+    // same, but only search the regions of interest of the image
+    void DetectMsrAruco(const aruco::CameraParameters &_CamParam,
+                        const aruco::MarkerDetector &_MarkerDetector,
+                        aruco::MarkerDetector::Workspace &_ws,
+                        double markSize,
+                        const std::vector<cv::Rect> &_vecRoi);
+
     inline const std::vector<aruco::Marker> & GetMsrAruco() const { return mvecMsrAruco; }
-    inline const cv::Mat GetImgAruco() const { return mImgAruco; }
+    // BGR image with the detected markers drawn, shared with the keyframe,
+    // clone it before modifying
+    cv::Mat GetImgAruco() const;
 
     void InsertMsrMk(PtrMsrKf2AMk pmsr);
     void DeleteMsrMk(PtrMsrKf2AMk pmsr);
@@ -60,7 +78,8 @@ public:
 
 private:
     std::vector<aruco::Marker> mvecMsrAruco;  // vector of aruco measurements in this KF
-    cv::Mat mImgAruco;
+    mutable cv::Mat mImgAruco;  // rendered on demand by GetImgAruco
+    mutable std::mutex mMutexImgAruco;  // guards mImgAruco
 
     set<PtrMsrKf2AMk> msetpMsrMk;
     set<PtrArucoMark> msetpMk;
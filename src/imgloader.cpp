@@ -0,0 +1,71 @@
+#include "imgloader.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+namespace calibcamodo {
+
+using namespace std;
+using namespace cv;
+
+ImgLoader::ImgLoader(const vector<string> &_vecPath, int _numThread, int _numBuffer,
+                     int _flagRead) :
+    mvecPath(_vecPath), mIdxLoad(0), mIdxOut(0), mFlagRead(_flagRead), mbStop(false) {
+
+    if (_numThread <= 0)
+        _numThread = max(1u, thread::hardware_concurrency());
+    mNumBuffer = max(_numBuffer, _numThread);
+
+    for (int i = 0; i < _numThread; ++i)
+        mvecThread.push_back(thread(&ImgLoader::Run, this));
+}
+
+ImgLoader::~ImgLoader() {
+    {
+        unique_lock<mutex> lock(mMutex);
+        mbStop = true;
+    }
+    mCondFree.notify_all();
+    for (auto &t : mvecThread)
+        t.join();
+}
+
+bool ImgLoader::Next(Mat &_img) {
+    unique_lock<mutex> lock(mMutex);
+    if (mIdxOut >= (int)mvecPath.size())
+        return false;
+
+    mCondLoaded.wait(lock, [this]{ return mmapIdx2Img.count(mIdxOut) > 0; });
+    auto iter = mmapIdx2Img.find(mIdxOut);
+    _img = iter->second;
+    mmapIdx2Img.erase(iter);
+    mIdxOut++;
+    lock.unlock();
+
+    mCondFree.notify_all();
+    return true;
+}
+
+void ImgLoader::Run() {
+    const int numImg = mvecPath.size();
+    while (true) {
+        int idx;
+        {
+            unique_lock<mutex> lock(mMutex);
+            mCondFree.wait(lock, [this, numImg]{
+                return mbStop || mIdxLoad >= numImg || mIdxLoad < mIdxOut + mNumBuffer; });
+            if (mbStop || mIdxLoad >= numImg)
+                return;
+            idx = mIdxLoad++;
+        }
+
+        Mat img = imread(mvecPath[idx], mFlagRead);
+
+        {
+            unique_lock<mutex> lock(mMutex);
+            mmapIdx2Img[idx] = img;
+        }
+        mCondLoaded.notify_all();
+    }
+}
+
+}
@@ -0,0 +1,48 @@
+#ifndef IMGLOADER_H
+#define IMGLOADER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include <opencv2/core/core.hpp>
+
+namespace calibcamodo {
+
+// Decode a list of images with a pool of worker threads. Images are
+// delivered in the order of the given paths, and at most numBuffer images
+// are decoded but not yet delivered at any time. _flagRead is passed to
+// cv::imread, e.g. CV_LOAD_IMAGE_GRAYSCALE to decode single channel images.
+class ImgLoader {
+public:
+    ImgLoader(const std::vector<std::string> &_vecPath, int _numThread, int _numBuffer,
+              int _flagRead);
+    ~ImgLoader();
+
+    // get the next image, an empty image is returned if decoding failed,
+    // return false if all images are delivered
+    bool Next(cv::Mat &_img);
+
+private:
+    void Run();
+
+    std::vector<std::string> mvecPath;
+    std::vector<std::thread> mvecThread;
+
+    std::mutex mMutex;
+    std::condition_variable mCondLoaded;
+    std::condition_variable mCondFree;
+    std::map<int, cv::Mat> mmapIdx2Img;
+
+    int mIdxLoad;   // next image to decode
+    int mIdxOut;    // next image to deliver
+    int mNumBuffer;
+    int mFlagRead;
+    bool mbStop;
+};
+
+}
+#endif // IMGLOADER_H
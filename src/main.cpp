@@ -48,8 +48,25 @@ int main(int argc, char **argv) {
 
     //! Init dataset
     Dataset dataset;
-    dataset.CreateFrame();
-    dataset.CreateKeyFrame();
+    if (!dataset.LoadCache()) {
+        bool bLoad;
+        if (Config::DATASET_LOAD_MODE == Dataset::LOAD_STREAM) {
+            bLoad = dataset.CreateKeyFrameStream();
+        }
+        else if (Config::DATASET_LOAD_MODE == Dataset::LOAD_ODOFIRST) {
+            bLoad = dataset.CreateKeyFrameOdoFirst();
+        }
+        else {
+            bLoad = dataset.CreateFrame();
+            if (bLoad)
+                dataset.CreateKeyFrame();
+        }
+        if (!bLoad) {
+            cerr << "Error in main, fail to load dataset in " << strFolderPathMain << endl;
+            return 1;
+        }
+        dataset.SaveCache();
+    }
     dataset.CreateMarkMeasure();    
 
     //! Init solver
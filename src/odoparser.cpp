@@ -0,0 +1,214 @@
+#include "odoparser.h"
+
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace calibcamodo {
+
+using namespace std;
+
+namespace {
+
+const int MAX_NUM_BAD_PRINT = 10;
+
+inline bool IsSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+inline const char* SkipSpace(const char *p, const char *end) {
+    while (p < end && IsSpace(*p)) ++p;
+    return p;
+}
+
+inline const char* SkipToken(const char *p, const char *end) {
+    while (p < end && !IsSpace(*p)) ++p;
+    return p;
+}
+
+bool ParseInt(const char *p, const char *end, int &out) {
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = (*p++ == '-');
+    if (p == end)
+        return false;
+    long val = 0;
+    for (; p < end; ++p) {
+        if (*p < '0' || *p > '9')
+            return false;
+        val = val*10 + (*p - '0');
+        if (val > 0x7fffffff)
+            return false;
+    }
+    out = neg ? -val : val;
+    return true;
+}
+
+// Decimal number in the form [+-]digits[.digits][(e|E)[+-]digits]. Up to 15
+// significant digits and a small exponent, mantissa and power of ten are both
+// exact in double so one multiply or divide is correctly rounded as strtod.
+// Longer numbers fall back to strtod on a bounded copy of the token.
+bool ParseFloat(const char *p, const char *end, float &out) {
+    static const double POW10[] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+        1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+
+    const char *begin = p;
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = (*p++ == '-');
+
+    unsigned long long mant = 0;
+    int numDigit = 0, numSig = 0, exp10 = 0;
+    for (; p < end && *p >= '0' && *p <= '9'; ++p, ++numDigit) {
+        if (mant == 0 && *p == '0') continue;
+        mant = mant*10 + (*p - '0');
+        numSig++;
+    }
+    if (p < end && *p == '.') {
+        for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++numDigit) {
+            exp10--;
+            if (mant == 0 && *p == '0') continue;
+            mant = mant*10 + (*p - '0');
+            numSig++;
+        }
+    }
+    if (numDigit == 0)
+        return false;
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        int e;
+        if (!ParseInt(p+1, end, e))
+            return false;
+        exp10 += e;
+        p = end;
+    }
+    if (p != end)
+        return false;
+
+    if (numSig <= 15 && exp10 >= -22 && exp10 <= 22) {
+        double val = exp10 >= 0 ? mant * POW10[exp10] : mant / POW10[-exp10];
+        out = neg ? -val : val;
+        return true;
+    }
+
+    char buf[64];
+    if (end - begin >= (long)sizeof(buf))
+        return false;
+    memcpy(buf, begin, end - begin);
+    buf[end - begin] = '\0';
+    out = strtod(buf, nullptr);
+    return true;
+}
+
+}
+
+bool OdoParser::Parse(const string &_strFilePath, vector<OdoRecord> &_vecOdo) {
+
+    mNumLine = mNumComment = mNumBad = 0;
+    _vecOdo.clear();
+
+    int fd = open(_strFilePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        cerr << "Error in OdoParser::Parse, can not open " << _strFilePath << endl;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        cerr << "Error in OdoParser::Parse, can not stat " << _strFilePath << endl;
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        return true;
+    }
+    void *pMap = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (pMap == MAP_FAILED) {
+        cerr << "Error in OdoParser::Parse, can not map " << _strFilePath << endl;
+        return false;
+    }
+    madvise(pMap, size, MADV_SEQUENTIAL);
+
+    // a data line is at least ~30 bytes, avoid most reallocations
+    _vecOdo.reserve(size/32);
+
+    const char *p = static_cast<const char*>(pMap);
+    const char *end = p + size;
+    bool bSorted = true;
+    while (p < end) {
+        const char *pEol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (!pEol) pEol = end;
+        mNumLine++;
+
+        const char *pBegin = SkipSpace(p, pEol);
+        if (pBegin == pEol) {
+            // empty line
+        }
+        else if (*pBegin == '#') {
+            mNumComment++;
+        }
+        else {
+            OdoRecord rec;
+            if (ParseLine(pBegin, pEol, rec)) {
+                if (!_vecOdo.empty() && rec.id <= _vecOdo.back().id)
+                    bSorted = false;
+                _vecOdo.push_back(rec);
+            }
+            else {
+                if (mNumBad < MAX_NUM_BAD_PRINT)
+                    cerr << "Error in OdoParser::Parse, bad line " << mNumLine << ": "
+                         << string(pBegin, pEol) << endl;
+                mNumBad++;
+            }
+        }
+        p = pEol + 1;
+    }
+    munmap(pMap, size);
+
+    // keep the last record of a repeated id, as logs are normally written in
+    // id order this is only done for unusual files
+    if (!bSorted) {
+        stable_sort(_vecOdo.begin(), _vecOdo.end(),
+                    [](const OdoRecord &a, const OdoRecord &b) { return a.id < b.id; });
+        auto iterOut = _vecOdo.begin();
+        for (auto iter = _vecOdo.begin(); iter != _vecOdo.end(); ++iter) {
+            if (iter+1 != _vecOdo.end() && (iter+1)->id == iter->id)
+                continue;
+            *iterOut++ = *iter;
+        }
+        _vecOdo.erase(iterOut, _vecOdo.end());
+    }
+
+    if (mNumBad > 0)
+        cerr << "Error in OdoParser::Parse, " << mNumBad << " bad lines in " << _strFilePath << endl;
+    return true;
+}
+
+bool OdoParser::ParseLine(const char *_pBegin, const char *_pEnd, OdoRecord &_rec) const {
+    const char *pToken[6];
+    const char *pTokenEnd[6];
+    const char *p = _pBegin;
+    for (int i = 0; i < 6; ++i) {
+        p = SkipSpace(p, _pEnd);
+        if (p == _pEnd)
+            return false;
+        pToken[i] = p;
+        p = SkipToken(p, _pEnd);
+        pTokenEnd[i] = p;
+    }
+
+    return ParseInt(pToken[0], pTokenEnd[0], _rec.id) &&
+            ParseFloat(pToken[3], pTokenEnd[3], _rec.odo.x) &&
+            ParseFloat(pToken[4], pTokenEnd[4], _rec.odo.y) &&
+            ParseFloat(pToken[5], pTokenEnd[5], _rec.odo.theta);
+}
+
+}
@@ -0,0 +1,39 @@
+#ifndef ODOPARSER_H
+#define ODOPARSER_H
+
+#include "type.h"
+#include <string>
+#include <vector>
+
+namespace calibcamodo {
+
+struct OdoRecord {
+    int id;
+    Se2 odo;
+};
+
+// Single pass parser of the odometry log (Odo.rec). The file is memory
+// mapped and tokenized in place, each data line "id t0 t1 x y theta ..."
+// is written into a compact array sorted by id. Comment lines start with
+// '#', any other line that can not be parsed is reported as bad.
+class OdoParser {
+public:
+    OdoParser() : mNumLine(0), mNumComment(0), mNumBad(0) {}
+
+    // return false if the file can not be read
+    bool Parse(const std::string &_strFilePath, std::vector<OdoRecord> &_vecOdo);
+
+    inline int GetNumLine() const { return mNumLine; }
+    inline int GetNumComment() const { return mNumComment; }
+    inline int GetNumBad() const { return mNumBad; }
+
+private:
+    bool ParseLine(const char *_pBegin, const char *_pEnd, OdoRecord &_rec) const;
+
+    int mNumLine;
+    int mNumComment;
+    int mNumBad;
+};
+
+}
+#endif // ODOPARSER_H
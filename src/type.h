@@ -74,6 +74,77 @@ struct Se3{
 std::ostream &operator<< (std::ostream &os, Se3 &se3);
 std::ostream &operator<< (std::ostream &os, Se2 &se2);
 
+// Storage of shared pointers indexed by a dense non-negative id, T::GetId().
+// Elements are kept contiguous and sorted by id, so iteration order is
+// deterministic, and an id to position table gives O(1) lookup.
+template<typename T>
+class IdStore {
+public:
+    typedef std::shared_ptr<T> Ptr;
+    typedef typename std::vector<Ptr>::const_iterator const_iterator;
+
+    // return false if the id is negative or already exists
+    bool Insert(const Ptr &_ptr) {
+        int id = _ptr->GetId();
+        if (id < 0 || Count(id))
+            return false;
+        if (id >= (int)mvecId2Idx.size())
+            mvecId2Idx.resize(id+1, -1);
+
+        // ids mostly come in increasing order, append in that case
+        if (mvecPtr.empty() || mvecPtr.back()->GetId() < id) {
+            mvecId2Idx[id] = mvecPtr.size();
+            mvecPtr.push_back(_ptr);
+            return true;
+        }
+        auto iter = std::lower_bound(mvecPtr.begin(), mvecPtr.end(), id,
+                                     [](const Ptr &_p, int _id) { return _p->GetId() < _id; });
+        int idx = iter - mvecPtr.begin();
+        mvecPtr.insert(iter, _ptr);
+        Reindex(idx);
+        return true;
+    }
+
+    bool Erase(int _id) {
+        if (!Count(_id))
+            return false;
+        int idx = mvecId2Idx[_id];
+        mvecId2Idx[_id] = -1;
+        mvecPtr.erase(mvecPtr.begin() + idx);
+        Reindex(idx);
+        return true;
+    }
+
+    bool Count(int _id) const {
+        return _id >= 0 && _id < (int)mvecId2Idx.size() && mvecId2Idx[_id] >= 0;
+    }
+
+    // return nullptr if the id does not exist
+    Ptr Find(int _id) const {
+        return Count(_id) ? mvecPtr[mvecId2Idx[_id]] : nullptr;
+    }
+
+    void Clear() {
+        mvecPtr.clear();
+        mvecId2Idx.clear();
+    }
+
+    const std::vector<Ptr> & Get() const { return mvecPtr; }
+    size_t Size() const { return mvecPtr.size(); }
+    bool Empty() const { return mvecPtr.empty(); }
+    const_iterator begin() const { return mvecPtr.cbegin(); }
+    const_iterator end() const { return mvecPtr.cend(); }
+
+private:
+    void Reindex(int _idxBegin) {
+        for (int i = _idxBegin; i < (int)mvecPtr.size(); ++i)
+            mvecId2Idx[mvecPtr[i]->GetId()] = i;
+    }
+
+    std::vector<Ptr> mvecPtr;     // elements sorted by id
+    std::vector<int> mvecId2Idx;  // position in mvecPtr, -1 if not exist
+};
+
 // Math functions:
 const double PI = 3.1415926;
 double Period(double in, double upperbound, double lowerbound);
@@ -0,0 +1,114 @@
+// Benchmark of OdoParser on a synthetic odometry log.
+//
+// usage: bench_odoparser [numLine] [filePath]
+//
+// A log of numLine records (default 5000000) in the format of Odo.rec is
+// written to filePath (default /tmp/Odo_bench.rec), then parsed with
+// OdoParser and with the getline/istringstream loop it replaced. The
+// records of OdoParser are checked against the generated values.
+
+#include "odoparser.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace calibcamodo;
+
+namespace {
+
+double Elapsed(chrono::steady_clock::time_point _t0) {
+    return chrono::duration<double>(chrono::steady_clock::now() - _t0).count();
+}
+
+// odometry of record i, a slow curve so that values have varied digits
+void GetOdo(int _i, float &_x, float &_y, float &_theta) {
+    _x = 1000.0f * cos(_i * 1e-4f);
+    _y = 1000.0f * sin(_i * 1e-4f);
+    _theta = fmod(_i * 1e-4f, 6.2831853f) - 3.1415927f;
+}
+
+bool WriteLog(const string &_strFilePath, int _numLine) {
+    FILE *fp = fopen(_strFilePath.c_str(), "w");
+    if (!fp)
+        return false;
+    fprintf(fp, "# id t0 t1 x y theta\n");
+    for (int i = 0; i < _numLine; ++i) {
+        float x, y, theta;
+        GetOdo(i, x, y, theta);
+        fprintf(fp, "%d %d %d %.6f %.6f %.6f\n", i, 1000*i, 1000*i + 3, x, y, theta);
+    }
+    return fclose(fp) == 0;
+}
+
+// the parse loop of Dataset before OdoParser
+int ParseStream(const string &_strFilePath) {
+    map<int, Se2> mapId2Odo;
+    ifstream file(_strFilePath);
+    string str;
+    while (getline(file, str)) {
+        if (str.empty() || str[0] == '#')
+            continue;
+        istringstream iss(str);
+        int id, t0, t1;
+        Se2 odo;
+        if (iss >> id >> t0 >> t1 >> odo.x >> odo.y >> odo.theta)
+            mapId2Odo[id] = odo;
+    }
+    return mapId2Odo.size();
+}
+
+}
+
+int main(int argc, char **argv) {
+
+    int numLine = argc > 1 ? atoi(argv[1]) : 5000000;
+    string strFilePath = argc > 2 ? argv[2] : "/tmp/Odo_bench.rec";
+
+    auto t0 = chrono::steady_clock::now();
+    if (!WriteLog(strFilePath, numLine)) {
+        cerr << "Error in bench_odoparser, fail to write " << strFilePath << endl;
+        return 1;
+    }
+    cerr << "write " << numLine << " lines: " << Elapsed(t0) << " s" << endl;
+
+    OdoParser parser;
+    vector<OdoRecord> vecOdo;
+    t0 = chrono::steady_clock::now();
+    if (!parser.Parse(strFilePath, vecOdo)) {
+        cerr << "Error in bench_odoparser, fail to parse " << strFilePath << endl;
+        return 1;
+    }
+    double timeParser = Elapsed(t0);
+
+    t0 = chrono::steady_clock::now();
+    int numStream = ParseStream(strFilePath);
+    double timeStream = Elapsed(t0);
+
+    // values are written with 6 decimals
+    int numWrong = vecOdo.size() == (size_t)numLine ? 0 : 1;
+    for (size_t i = 0; i < vecOdo.size() && numWrong == 0; ++i) {
+        float x, y, theta;
+        GetOdo(i, x, y, theta);
+        if (vecOdo[i].id != (int)i || fabs(vecOdo[i].odo.x - x) > 1e-3f ||
+                fabs(vecOdo[i].odo.y - y) > 1e-3f || fabs(vecOdo[i].odo.theta - theta) > 1e-5f)
+            ++numWrong;
+    }
+
+    cerr << "OdoParser: " << vecOdo.size() << " records, " << timeParser << " s" << endl;
+    cerr << "getline/istringstream: " << numStream << " records, " << timeStream << " s" << endl;
+    cerr << "speedup: " << timeStream / timeParser << endl;
+    if (numWrong > 0) {
+        cerr << "Error in bench_odoparser, records do not match the generated log" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Accuracy check of aruco::PlanarSquarePose against Marker::calculateExtrinsics
+// (cv::solvePnP) on synthetic poses.
+//
+// usage: check_planarpose [numPose] [noise]
+//
+// numPose marker poses (default 1000) are drawn at random in the view of a
+// 640x480 camera, with and without lens distortion. Their corners are
+// projected, with gaussian noise of sigma noise pixels (default 0.2), and
+// the pose is solved with solvePnP, with PlanarSquarePose and with
+// PlanarSquarePose on the undistortion table of CameraParameters. The
+// differences of pose and of reprojection error to solvePnP are printed.
+// Returns 1 if PlanarSquarePose is not as accurate as solvePnP.
+
+#include "aruco/aruco.h"
+#include "aruco/planarpose.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/calib3d/calib3d.hpp>
+
+using namespace std;
+using namespace cv;
+using namespace aruco;
+
+namespace {
+
+const float MARKER_SIZE = 0.1f;
+
+// corners of the marker in its frame, in the order of Marker::calculateExtrinsics
+vector<Point3f> GetObjPoints() {
+    float h = MARKER_SIZE / 2;
+    vector<Point3f> vecPt;
+    vecPt.push_back(Point3f(-h, -h, 0));
+    vecPt.push_back(Point3f(-h, h, 0));
+    vecPt.push_back(Point3f(h, h, 0));
+    vecPt.push_back(Point3f(h, -h, 0));
+    return vecPt;
+}
+
+double ReprojError(const Marker &_mk, const Mat &_K, const Mat &_D) {
+    vector<Point2f> vecPt;
+    projectPoints(GetObjPoints(), _mk.Rvec, _mk.Tvec, _K, _D, vecPt);
+    double err = 0;
+    for (int c = 0; c < 4; ++c)
+        err += norm(vecPt[c] - _mk[c]) * norm(vecPt[c] - _mk[c]);
+    return sqrt(err / 4);
+}
+
+// angle in degrees of the rotation between the two markers
+double RotDiff(const Marker &_mk1, const Marker &_mk2) {
+    Mat R1, R2, rvec;
+    Rodrigues(_mk1.Rvec, R1);
+    Rodrigues(_mk2.Rvec, R2);
+    Rodrigues(R1.t() * R2, rvec);
+    return norm(rvec) * 180 / CV_PI;
+}
+
+// translation difference relative to the distance of the marker
+double TransDiff(const Marker &_mk1, const Marker &_mk2) {
+    return norm(_mk1.Tvec - _mk2.Tvec) / norm(_mk1.Tvec);
+}
+
+struct Result {
+    double rotMax, transMax, reprojMax;
+    Result() : rotMax(0), transMax(0), reprojMax(0) {}
+    void Add(const Marker &_mkPnp, const Marker &_mk, const Mat &_K, const Mat &_D) {
+        rotMax = max(rotMax, RotDiff(_mkPnp, _mk));
+        transMax = max(transMax, TransDiff(_mkPnp, _mk));
+        reprojMax = max(reprojMax, ReprojError(_mk, _K, _D) - ReprojError(_mkPnp, _K, _D));
+    }
+};
+
+bool Check(const string &_strName, const Mat &_D, int _numPose, double _noise) {
+    Mat K = (Mat_<float>(3,3) << 800, 0, 320, 0, 800, 240, 0, 0, 1);
+    CameraParameters camParams(K, _D, Size(640, 480));
+    RNG rng(0x12345);
+
+    vector<Marker> vecMkPnp, vecMkPlanar, vecMkTable;
+    while ((int)vecMkPnp.size() < _numPose) {
+        // marker facing the camera, tilted up to 60 degrees
+        double z = rng.uniform(0.3, 2.0);
+        Mat tvec = (Mat_<double>(3,1) << rng.uniform(-0.3, 0.3) * z, rng.uniform(-0.2, 0.2) * z, z);
+        Mat rvecTilt = (Mat_<double>(3,1) << rng.uniform(-1.0, 1.0), rng.uniform(-1.0, 1.0), 0);
+        Mat rvecSpin = (Mat_<double>(3,1) << 0, 0, rng.uniform(-CV_PI, CV_PI));
+        Mat RTilt, RSpin, rvec;
+        Rodrigues(rvecTilt, RTilt);
+        Rodrigues(rvecSpin, RSpin);
+        Rodrigues(RTilt * RSpin, rvec);
+
+        vector<Point2f> vecPt;
+        projectPoints(GetObjPoints(), rvec, tvec, K, _D, vecPt);
+        bool bInside = true;
+        for (auto &pt : vecPt) {
+            pt.x += rng.gaussian(_noise);
+            pt.y += rng.gaussian(_noise);
+            bInside = bInside && pt.x >= 0 && pt.x < 640 && pt.y >= 0 && pt.y < 480;
+        }
+        if (!bInside)
+            continue;
+        vecMkPnp.push_back(Marker(vecPt, vecMkPnp.size()));
+    }
+    vecMkPlanar = vecMkPnp;
+    vecMkTable = vecMkPnp;
+
+    for (auto &mk : vecMkPnp)
+        mk.calculateExtrinsics(MARKER_SIZE, K, _D, false);
+    PlanarSquarePose::calculateExtrinsics(vecMkPlanar, MARKER_SIZE, K, _D, false);
+    PlanarSquarePose::calculateExtrinsics(vecMkTable, MARKER_SIZE, camParams, false);
+
+    Result resPlanar, resTable;
+    for (int i = 0; i < _numPose; ++i) {
+        resPlanar.Add(vecMkPnp[i], vecMkPlanar[i], K, _D);
+        resTable.Add(vecMkPnp[i], vecMkTable[i], K, _D);
+    }
+
+    cerr << _strName << ", " << _numPose << " poses, max difference to solvePnP" << endl;
+    cerr << "  PlanarSquarePose: rotation " << resPlanar.rotMax << " deg, translation " << resPlanar.transMax * 100
+         << " %, reprojection error " << resPlanar.reprojMax << " px" << endl;
+    cerr << "  PlanarSquarePose, table: rotation " << resTable.rotMax << " deg, translation " << resTable.transMax * 100
+         << " %, reprojection error " << resTable.reprojMax << " px" << endl;
+
+    // the reprojection error must not be worse than the one of solvePnP,
+    // the table only adds its interpolation error
+    return resPlanar.reprojMax < 0.01 && resTable.reprojMax < 0.05;
+}
+
+}
+
+int main(int argc, char **argv) {
+
+    int numPose = argc > 1 ? atoi(argv[1]) : 1000;
+    double noise = argc > 2 ? atof(argv[2]) : 0.2;
+
+    Mat D0 = Mat::zeros(4, 1, CV_32FC1);
+    Mat D1 = (Mat_<float>(4,1) << -0.2f, 0.05f, 0.001f, -0.001f);
+    bool bOk = Check("no distortion", D0, numPose, noise);
+    bOk = Check("distortion", D1, numPose, noise) && bOk;
+    if (!bOk) {
+        cerr << "Error in check_planarpose, PlanarSquarePose is less accurate than solvePnP" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+// Comparison of the fast LINES corner refinement (MarkerDetector::enableFastLineFit)
+// with the SVD fit of all the contour points.
+//
+// usage: compare_linefit [numImg]
+//
+// numImg synthetic images (default 50) with 12 markers each, of sides from
+// 60 to 320 pixels under a random perspective, are blurred and get gaussian
+// noise. They are detected with LINES refinement and each fit, and the
+// corners are compared with the true ones. The error, the identification
+// time (which includes the refinement) and the markers left unrefined by
+// the fast fit are printed. Returns 1 if the fast fit finds other markers
+// or is less accurate than the SVD fit.
+
+#include "aruco/aruco.h"
+#include "aruco/arucofidmarkers.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+using namespace std;
+using namespace cv;
+using namespace aruco;
+
+namespace {
+
+const int IMG_COLS = 1600;
+const int IMG_ROWS = 1200;
+const int GRID_COLS = 4;
+const int GRID_ROWS = 3;
+
+struct Result {
+    int numFound;
+    double errSum, errMax, timeIdentify;
+    long numUnrefined;
+    Result() : numFound(0), errSum(0), errMax(0), timeIdentify(0), numUnrefined(0) {}
+};
+
+// image with a marker in each cell of the grid, the true corners of marker
+// id are in vecCorners[id]
+void CreateImage(RNG &_rng, Mat &_img, vector<vector<Point2f> > &_vecCorners) {
+    _img.create(IMG_ROWS, IMG_COLS, CV_8UC1);
+    _img.setTo(Scalar(255));
+    _vecCorners.clear();
+
+    // marker images of 10 pixels per cell, the marker border is at the pixel
+    // edges -0.5 and 69.5
+    Point2f src[4] = {Point2f(-0.5f, -0.5f), Point2f(69.5f, -0.5f), Point2f(69.5f, 69.5f), Point2f(-0.5f, 69.5f)};
+    int cellCols = IMG_COLS / GRID_COLS, cellRows = IMG_ROWS / GRID_ROWS;
+    for (int gy = 0; gy < GRID_ROWS; ++gy) {
+        for (int gx = 0; gx < GRID_COLS; ++gx) {
+            int id = _vecCorners.size();
+            Mat marker = FiducidalMarkers::createMarkerImage(id, 70);
+            float side = _rng.uniform(60.f, 320.f);
+            float angle = _rng.uniform(0.f, float(2 * CV_PI));
+            Point2f center(cellCols * (gx + 0.5f), cellRows * (gy + 0.5f));
+            Point2f dst[4];
+            vector<Point2f> corners;
+            for (int c = 0; c < 4; ++c) {
+                // square corner rotated by angle, moved up to 8% of the side
+                float a = angle + float(CV_PI) * (0.25f + 0.5f * c);
+                float r = side * 0.7071f;
+                dst[c] = center + Point2f(r * cos(a), r * sin(a)) +
+                        Point2f(_rng.uniform(-0.08f, 0.08f) * side, _rng.uniform(-0.08f, 0.08f) * side);
+                corners.push_back(dst[c]);
+            }
+            Mat H = getPerspectiveTransform(src, dst);
+            warpPerspective(marker, _img, H, _img.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+            _vecCorners.push_back(corners);
+        }
+    }
+
+    GaussianBlur(_img, _img, Size(3, 3), 0.8);
+    Mat imgNoise;
+    _img.convertTo(imgNoise, CV_32F);
+    Mat noise(_img.size(), CV_32F);
+    _rng.fill(noise, RNG::NORMAL, 0, 2);
+    imgNoise += noise;
+    imgNoise.convertTo(_img, CV_8U);
+}
+
+void Detect(const MarkerDetector &_detector, MarkerDetector::Workspace &_ws, const Mat &_img,
+            const vector<vector<Point2f> > &_vecCorners, Result &_res) {
+    vector<Marker> vecMk;
+    _detector.detect(_img, vecMk, _ws);
+    for (const auto &mk : vecMk) {
+        if (mk.id < 0 || mk.id >= (int)_vecCorners.size())
+            continue;
+        ++_res.numFound;
+        // detected corners are compared with the nearest true corner
+        for (int c = 0; c < 4; ++c) {
+            double err = 1e10;
+            for (const auto &pt : _vecCorners[mk.id])
+                err = min(err, (double)norm(mk[c] - pt));
+            _res.errSum += err;
+            _res.errMax = max(_res.errMax, err);
+        }
+    }
+}
+
+void Print(const string &_strName, const Result &_res, int _numImg) {
+    cerr << _strName << ": " << _res.numFound << " markers, corner error mean "
+         << _res.errSum / max(1, 4 * _res.numFound) << " px, max " << _res.errMax << " px, identify "
+         << _res.timeIdentify * 1000 / _numImg << " ms per image, unrefined " << _res.numUnrefined << endl;
+}
+
+}
+
+int main(int argc, char **argv) {
+
+    int numImg = argc > 1 ? atoi(argv[1]) : 50;
+
+    MarkerDetector detectorSvd, detectorFast;
+    detectorSvd.setCornerRefinementMethod(MarkerDetector::LINES);
+    detectorFast.setCornerRefinementMethod(MarkerDetector::LINES);
+    detectorSvd.enableFastLineFit(false);
+    detectorFast.enableFastLineFit(true);
+    MarkerDetector::Workspace wsSvd, wsFast;
+
+    RNG rng(0x12345);
+    Result resSvd, resFast;
+    for (int i = 0; i < numImg; ++i) {
+        Mat img;
+        vector<vector<Point2f> > vecCorners;
+        CreateImage(rng, img, vecCorners);
+        Detect(detectorSvd, wsSvd, img, vecCorners, resSvd);
+        Detect(detectorFast, wsFast, img, vecCorners, resFast);
+    }
+    resSvd.timeIdentify = wsSvd.stats.time[MarkerDetector::Stats::IDENTIFY];
+    resFast.timeIdentify = wsFast.stats.time[MarkerDetector::Stats::IDENTIFY];
+    resFast.numUnrefined = wsFast.stats.lineFitUnrefined;
+
+    Print("SVD fit", resSvd, numImg);
+    Print("fast fit", resFast, numImg);
+
+    double errSvd = resSvd.errSum / max(1, 4 * resSvd.numFound);
+    double errFast = resFast.errSum / max(1, 4 * resFast.numFound);
+    if (resFast.numFound != resSvd.numFound || errFast > errSvd + 0.05) {
+        cerr << "Error in compare_linefit, the fast fit is less accurate than the SVD fit" << endl;
+        return 1;
+    }
+    return 0;
+}